@@ -4,14 +4,72 @@
 
 #include <vector>
 #include <memory>
+#include <cstddef>
 #include <cstdint>
 #include <istream>
 #include <ostream>
+#include <memory_resource>
+#include <chrono>
 
 namespace Compression {
 
+// Strategy the compressor uses to find the longest match in the window
+enum class LzssMatchFinder {
+    // Okumura binary search trees; best ratio
+    BinaryTree,
+    // Hash chains keyed on the first minMatchLength + 1 bytes; faster
+    HashChain
+};
+
+// Layout of a match token, selected from the window shape. The values double
+// as the LZSF frame version.
+enum class LzssTokenFormat : uint8_t {
+    // Two bytes: 12-bit window position, 4-bit length. Fits frameSize up to
+    // 4096 and maxMatchLength up to minMatchLength + 16
+    Classic = 1,
+    // Three bytes: 16-bit window position, 8-bit length. Fits frameSize up
+    // to 65536 and maxMatchLength up to minMatchLength + 256; needs
+    // minMatchLength >= 2 so a match never costs more than its literals
+    Wide = 2
+};
+
+class LzssDictionary;
+
+// Counters a codec adds to while LzssSettings::stats points at them. Token
+// and match finder counts come from the compressor; byte counts and phase
+// times from both sides. Counts accumulate over calls and codecs until the
+// object is reset, and one object must not be updated by codecs running
+// concurrently (the framed API merges per-block counts itself).
+struct LzssStats {
+    // Bytes consumed and produced
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    // Tokens written by the compressor
+    uint64_t literals = 0;
+    uint64_t matches = 0;
+    // matchLengths[n] is the number of matches n bytes long
+    std::vector<uint64_t> matchLengths;
+    // Match finder searches, one per window position inserted, and the tree
+    // nodes or chain links they visited
+    uint64_t searches = 0;
+    uint64_t searchSteps = 0;
+    // Nodes unlinked from the binary trees as the window slides
+    uint64_t nodeDeletions = 0;
+    // Wall time spent resetting or loading the match finder, compressing
+    // and decompressing
+    std::chrono::nanoseconds initTime{0};
+    std::chrono::nanoseconds compressTime{0};
+    std::chrono::nanoseconds decompressTime{0};
+
+    double AverageSearchDepth() const {
+        return searches != 0 ? static_cast<double>(searchSteps) / searches : 0.0;
+    }
+
+    LzssStats& operator+=(const LzssStats& other);
+};
+
 struct LzssSettings {
-    // The size of the sliding window
+    // The size of the sliding window; a power of two
     int32_t frameSize = 0x1000;
     // The value used to fill the sliding window
     uint8_t frameFill = 0;
@@ -21,41 +79,320 @@ struct LzssSettings {
     int32_t maxMatchLength = 0x12;
     // Minimum match length
     int32_t minMatchLength = 2;
+    // Size of the blocks read from the input and written to the output stream
+    int32_t ioBufferSize = 0x10000;
+    // Match finder used by the compressor
+    LzssMatchFinder matchFinder = LzssMatchFinder::BinaryTree;
+    // Candidates examined per position by the hash chain match finder
+    int32_t chainDepth = 16;
+    // Defer a match by one byte when the next position has a longer one
+    bool lazyMatching = false;
+    // Collect the longest match at every position of a block of input and
+    // emit the token sequence with the fewest bits for the whole block,
+    // instead of deciding one position at a time; lazyMatching is ignored.
+    // Encoding is slower, the output decodes like any other stream.
+    bool optimalParsing = false;
+    // 0 uses matchFinder, chainDepth, lazyMatching and optimalParsing as
+    // given; 1 (fastest) to 8 (smallest output) select a preset that
+    // overrides them. Level 6 is the classic greedy binary tree, level 8 the
+    // binary tree with optimal parsing
+    int32_t compressionLevel = 0;
+    // Source of the codec's working memory (window, match finder arrays and
+    // stream chunks); nullptr uses std::pmr::get_default_resource(). It must
+    // be usable from every thread that runs a codec with these settings.
+    std::pmr::memory_resource* memoryResource = nullptr;
+    // Preset dictionary the window starts out with; see LzssDictionary. It
+    // must outlive every codec created with these settings.
+    const LzssDictionary* dictionary = nullptr;
+    // Statistics to collect into; nullptr (the default) skips all counting
+    LzssStats* stats = nullptr;
 };
 
 class LzssCompression {
 public:
     explicit LzssCompression(std::istream& input, std::ostream& output, bool compress = false, 
                            const LzssSettings& settings = LzssSettings());
+    // Creates a codec that is only used through the memory overloads
+    explicit LzssCompression(bool compress, const LzssSettings& settings = LzssSettings());
     ~LzssCompression();
 
+    // Bytes of window and match finder memory one codec requests from its
+    // memory resource, for sizing arenas; stream use adds two chunks of
+    // ioBufferSize per call
+    static size_t WorkingMemorySize(const LzssSettings& settings, bool compress);
+
     void Compress();
     void Decompress();
 
+    // Restores the initial window and match finder state so the next call
+    // starts a new stream, keeping every working array allocated. Only the
+    // part of the window the previous stream reached is reinitialized.
+    // Compress() always starts a new stream, so a compressor only needs it
+    // to drop a stream fed but not finished; a decompressor carries its
+    // window over from one call to the next until it is reset.
+    void Reset();
+    // Same, and attaches the codec to a new pair of streams
+    void Reset(std::istream& input, std::ostream& output);
+
+    // Memory overloads; the vector variants append to output
+    void Compress(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output);
+    size_t Compress(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity);
+    void Decompress(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output);
+    // Decodes straight into a preallocated buffer and returns the number of
+    // bytes written; decoding stops once outputCapacity bytes are produced
+    size_t Decompress(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity);
+
+    // Incremental compression for input that arrives in pieces. Feed() takes
+    // all of input and appends the tokens that can already be decided to
+    // output; the last maxMatchLength bytes stay in the window as lookahead
+    // (with optimalParsing, up to a parse block of positions waits for its
+    // tokens), so feeding a stream in any split produces the same bytes as
+    // one Compress() call.
+    // Flush() also encodes the lookahead, so everything fed so far can be
+    // decoded, at the cost of some ratio: the rest of the current flag group
+    // is sent as literals. Finish() ends the stream; the next Feed() starts
+    // a new one from the initial window, which a fresh decoder reads on its
+    // own. A one-shot Compress() abandons an unfinished stream.
+    void Feed(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output);
+    void Flush(std::vector<uint8_t>& output);
+    void Finish(std::vector<uint8_t>& output);
+
+    // Resumable decompression with bounded output. Decodes input into output
+    // until outputCapacity bytes are written or the input is used up, stores
+    // the number of input bytes consumed in inputUsed and returns the number
+    // of bytes written. A token cut off by either limit, including a match
+    // that is only partly written, is kept in the codec, so the next call
+    // continues from exactly that point with the rest of the input and a
+    // fresh output buffer. Reset() starts over with a new stream.
+    size_t DecompressStep(const uint8_t* input, size_t inputSize, size_t& inputUsed,
+                          uint8_t* output, size_t outputCapacity);
+
 private:
+    friend class LzssDictionary;
+
+    // How far CompressImpl() encodes the input it is given
+    enum class EncodeMode {
+        // Stop while a token could still depend on input not yet fed
+        Buffer,
+        // Encode everything and send the partial flag group
+        Flush,
+        // Encode everything and end the stream
+        Finish
+    };
+
+    // The hot loops take the window shape as a template parameter so that a
+    // shape known at compile time can be folded into them
+    template <typename Shape, typename Reader, typename Writer>
+    void CompressImpl(Shape shape, Reader& reader, Writer& writer, EncodeMode mode);
+    template <typename Shape, typename Reader, typename Writer>
+    void DecompressImpl(Shape shape, Reader& reader, Writer& writer);
+    template <typename Shape>
+    size_t DecodeStep(Shape shape, const uint8_t* input, size_t inputSize, size_t& inputUsed,
+                      uint8_t* output, size_t outputCapacity);
+    template <typename Shape>
+    bool DecodeInto(Shape shape, const uint8_t* input, size_t inputSize, size_t& inPos, uint32_t& flag,
+                    uint8_t* output, size_t& outPos, size_t outputCapacity, bool stopEarly);
+    void SyncWindow(const uint8_t* output, size_t outputSize);
+    void CountDecoded(size_t inputSize, size_t outputSize);
+
     void InitCompress();
+    void BeginStream();
+    void Prime(const uint8_t* data, size_t size);
+    void LoadDictionary();
     void InitTree();
-    void InsertNode(int32_t r);
-    void DeleteNode(int32_t p);
+    void RestoreWindow();
+    int32_t DirtySpan() const;
+    // Inserts return the number of candidates visited, deletes whether a
+    // node was unlinked, for LzssStats
+    template <typename Shape>
+    int32_t InsertNode(Shape shape, int32_t r);
+    template <typename Shape>
+    bool DeleteNode(Shape shape, int32_t p);
+    template <typename Shape, typename Node>
+    int32_t InsertTreeNode(Shape shape, Node* tree, int32_t r);
+    template <typename Shape, typename Node>
+    bool DeleteTreeNode(Shape shape, Node* tree, int32_t p);
+    template <typename Node>
+    void ClearTree(Node* tree, int32_t begin, int32_t span);
+    template <typename Shape>
+    int32_t InsertString(Shape shape, int32_t r);
+    template <typename Shape>
+    bool DeleteString(Shape shape, int32_t p);
+    template <typename Shape>
+    int32_t HashAt(Shape shape, int32_t r) const;
+    template <typename Shape>
+    int32_t InsertHashChain(Shape shape, int32_t r);
 
-    std::istream& input_;
-    std::ostream& output_;
-    std::vector<uint8_t> buffer_;
+    std::istream* input_;
+    std::ostream* output_;
     bool isCompress_;
     LzssSettings settings_;
+    std::pmr::vector<uint8_t> buffer_;
 
-    // Tree-related members
-    std::vector<int32_t> leftChildren_;    // left children
-    std::vector<int32_t> rightChildren_;   // right children
-    std::vector<int32_t> parents_;
+    // Tree-related members. The links of a node share one record so a tree
+    // hop touches a single cache line; windows up to 32 KiB (whose indices
+    // and 256 roots fit in 16 bits) use the narrow layout. Nodes are left
+    // uninitialized: a stream writes the links of every node it inserts and
+    // never reads those of a node it did not (see EncoderState::fresh), so
+    // only the roots are reset per stream.
+    template <typename Index>
+    struct TreeNode {
+        TreeNode() {}
+        Index left;     // left child
+        Index right;    // right child
+        Index parent;
+    };
+    std::pmr::vector<TreeNode<uint16_t>> narrowTree_;
+    std::pmr::vector<TreeNode<int32_t>> wideTree_;
+    // Hash chain members. Each head holds the stamp of the stream that wrote
+    // it above the position; heads with another stamp read as empty, so a new
+    // stream only has to bump hashStamp_.
+    std::pmr::vector<uint32_t> hashHeads_;
+    std::pmr::vector<int32_t> hashChain_;
+    uint32_t hashStamp_;
+    // Positions collected for optimal parsing: the longest match found at
+    // each and its literal byte, then the fewest bits from there to the end
+    // of the block and the token length that achieves them
+    struct ParseStep {
+        ParseStep() {}
+        uint32_t cost;
+        uint16_t position;
+        uint16_t length;
+        uint16_t choice;
+        uint8_t literal;
+    };
+    std::pmr::vector<ParseStep> parse_;
     int32_t matchLength_;
     int32_t matchPosition_;
+
+    // Compressor position kept between incremental calls: r is the next
+    // byte to encode, s the next slot to refill, len the lookahead bytes
+    // present and pending the window steps still waiting for input. While
+    // filling, the lookahead is being loaded and r is not in the match
+    // finder yet. codeBuf holds the current flag group, of which the first
+    // codeBufSent bytes are already out after a Flush(). With optimal
+    // parsing, parsed positions wait in parse_ for their block to be encoded.
+    // fresh counts the slots the window refills before it reaches one this
+    // stream inserted; those cannot be in the tree, so they are not deleted.
+    struct EncoderState {
+        int32_t r;
+        int32_t s;
+        int32_t len;
+        int32_t pending;
+        int32_t fresh;
+        size_t parsed;
+        bool active;
+        bool started;
+        bool filling;
+        uint8_t mask;
+        size_t codeBufPtr;
+        size_t codeBufSent;
+        uint8_t codeBuf[25];
+    };
+    EncoderState encoder_;
+
+    // Decoder position kept between DecompressStep() calls: the flag group
+    // (pre-shifted, so bit 9 tells whether bits are left), the bytes of a
+    // token cut off by the end of the input, and the ring position and
+    // length of a match not yet fully written
+    struct DecoderState {
+        uint32_t flag;
+        uint8_t token[3];
+        int32_t tokenSize;
+        int32_t matchFrom;
+        int32_t matchLeft;
+    };
+    DecoderState decoder_;
+
+    // Window position of a fresh stream, and how far the window has moved
+    // since then; together they bound the slots Reset() has to restore
+    int32_t initialFramePos_;
+    uint64_t windowAdvance_;
 };
 
-// Helper functions that use memory streams for convenience
+// A preset dictionary for small messages that share content. The last
+// frameSize - maxMatchLength bytes of data are placed in the window just
+// before frameInitPos and inserted into the match finder once; every codec
+// created with settings pointing at the dictionary then starts each stream
+// from a copy of that state, so references into the dictionary cost no
+// per-message work. Compressor and decompressor have to use the same
+// dictionary bytes, window shape, frameInitPos and frameFill; compressors
+// also the same match finder. Codecs with other settings throw
+// std::invalid_argument.
+class LzssDictionary {
+public:
+    LzssDictionary(const uint8_t* data, size_t size, const LzssSettings& settings = LzssSettings());
+    ~LzssDictionary();
+
+private:
+    friend class LzssCompression;
+    // A compressor holding the primed window and match finder
+    std::unique_ptr<LzssCompression> primed_;
+};
+
+// LzssCompression with the window shape fixed at compile time. The default
+// 4096/18/2 shape runs hot loops specialised for it, with the window masks
+// and match lengths folded to constants; other shapes are checked here and
+// run the generic loops.
+template <int32_t FrameSize = 0x1000, int32_t MaxMatchLength = 0x12, int32_t MinMatchLength = 2>
+class LzssCodec : public LzssCompression {
+    static_assert(FrameSize > 0 && (FrameSize & (FrameSize - 1)) == 0, "FrameSize must be a power of two");
+    static_assert(MinMatchLength > 0 && MinMatchLength < MaxMatchLength, "Invalid match length range");
+    static_assert(FrameSize <= 0x10000 && MaxMatchLength <= MinMatchLength + 256 &&
+                  (MinMatchLength >= 2 || (FrameSize <= 0x1000 && MaxMatchLength <= MinMatchLength + 16)),
+                  "Shape does not fit any token format");
+
+public:
+    // The given settings with this codec's shape; the window starts
+    // MaxMatchLength bytes before its end, as in the classic layout
+    static LzssSettings Settings(LzssSettings settings = LzssSettings()) {
+        settings.frameSize = FrameSize;
+        settings.maxMatchLength = MaxMatchLength;
+        settings.minMatchLength = MinMatchLength;
+        settings.frameInitPos = FrameSize - MaxMatchLength;
+        return settings;
+    }
+
+    LzssCodec(std::istream& input, std::ostream& output, bool compress = false,
+              const LzssSettings& settings = LzssSettings())
+        : LzssCompression(input, output, compress, Settings(settings))
+    {
+    }
+
+    explicit LzssCodec(bool compress, const LzssSettings& settings = LzssSettings())
+        : LzssCompression(compress, Settings(settings))
+    {
+    }
+};
+
+// Token format a stream written with settings uses; throws
+// std::invalid_argument when the shape fits none
+LzssTokenFormat GetTokenFormat(const LzssSettings& settings);
+
+// Largest possible compressed size for inputSize bytes (all literals)
+size_t CompressBound(size_t inputSize);
+// Largest possible output of inputSize bytes of LZSS written with settings
+// (every token a match of the longest length the format can encode)
+size_t DecompressBound(size_t inputSize, const LzssSettings& settings = LzssSettings());
+
+// Helper functions for in-memory data
 std::vector<uint8_t> CompressData(const std::vector<uint8_t>& input);
 std::vector<uint8_t> DecompressData(const std::vector<uint8_t>& input);
 
+// Overloads that work directly on caller memory. The vector variants replace
+// the contents of output and reuse its capacity; the buffer variant returns
+// the number of bytes written and throws std::length_error when the buffer
+// is too small (CompressBound() bytes is always enough).
+void CompressData(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output,
+                  const LzssSettings& settings = LzssSettings());
+size_t CompressData(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity,
+                    const LzssSettings& settings = LzssSettings());
+void DecompressData(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output,
+                    const LzssSettings& settings = LzssSettings());
+// Decodes into a buffer sized for the known uncompressed length
+size_t DecompressData(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity,
+                      const LzssSettings& settings = LzssSettings());
+
 } // namespace Compression
 
 #endif // LZSS_HPP
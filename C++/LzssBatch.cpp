@@ -0,0 +1,118 @@
+#include "LzssBatch.hpp"
+#include "LzssParallel.hpp"
+#include <stdexcept>
+#include <algorithm>
+
+namespace Compression {
+
+namespace {
+
+// Splits count records into workers contiguous runs of similar total size;
+// run w covers records [runs[w], runs[w + 1])
+std::vector<size_t> SplitRuns(const LzssSpan* inputs, size_t count, size_t workers) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += inputs[i].size + 1;
+    }
+    std::vector<size_t> runs(workers + 1, count);
+    runs[0] = 0;
+    uint64_t seen = 0;
+    size_t w = 1;
+    for (size_t i = 0; i < count && w < workers; i++) {
+        seen += inputs[i].size + 1;
+        while (w < workers && seen * workers >= total * w) {
+            runs[w++] = i + 1;
+        }
+    }
+    return runs;
+}
+
+void RunBatch(const LzssSpan* inputs, size_t count, std::vector<uint8_t>& output, std::vector<size_t>& offsets,
+              const LzssBatchSettings& settings, bool compress) {
+    output.clear();
+    offsets.assign(count + 1, 0);
+    if (count == 0) {
+        return;
+    }
+
+    const size_t workers = detail::WorkerCount(settings.threadCount, count);
+    const std::vector<size_t> runs = SplitRuns(inputs, count, workers);
+    // The first run is written straight into output, the others into parts
+    // that are appended once every worker is done
+    std::vector<std::vector<uint8_t>> parts(workers - 1);
+    std::vector<LzssStats> stats(settings.codec.stats != nullptr ? workers : 0);
+
+    detail::ParallelFor(workers, workers, [&](size_t w) {
+        std::vector<uint8_t>& part = w == 0 ? output : parts[w - 1];
+        LzssSettings codec = settings.codec;
+        if (codec.stats != nullptr) {
+            codec.stats = &stats[w];
+        }
+
+        // Reserving the whole run up front keeps the per-record reserve in
+        // Compress() from reallocating on every record
+        size_t bound = 0;
+        for (size_t i = runs[w]; i < runs[w + 1]; i++) {
+            bound += compress ? CompressBound(inputs[i].size) : inputs[i].size * 2;
+        }
+        part.reserve(bound);
+
+        LzssCompression lzss(compress, codec);
+        for (size_t i = runs[w]; i < runs[w + 1]; i++) {
+            if (i != runs[w]) {
+                lzss.Reset();
+            }
+            offsets[i] = part.size();
+            if (compress) {
+                lzss.Compress(inputs[i].data, inputs[i].size, part);
+            } else {
+                lzss.Decompress(inputs[i].data, inputs[i].size, part);
+            }
+        }
+    });
+
+    size_t total = output.size();
+    for (size_t w = 1; w < workers; w++) {
+        total += parts[w - 1].size();
+    }
+    output.reserve(total);
+    for (size_t w = 1; w < workers; w++) {
+        for (size_t i = runs[w]; i < runs[w + 1]; i++) {
+            offsets[i] += output.size();
+        }
+        output.insert(output.end(), parts[w - 1].begin(), parts[w - 1].end());
+        std::vector<uint8_t>().swap(parts[w - 1]);
+    }
+    offsets[count] = output.size();
+
+    for (const LzssStats& worker : stats) {
+        *settings.codec.stats += worker;
+    }
+}
+
+} // namespace
+
+void CompressBatch(const LzssSpan* inputs, size_t count, std::vector<uint8_t>& output,
+                   std::vector<size_t>& offsets, const LzssBatchSettings& settings) {
+    RunBatch(inputs, count, output, offsets, settings, true);
+}
+
+void DecompressBatch(const LzssSpan* inputs, size_t count, std::vector<uint8_t>& output,
+                     std::vector<size_t>& offsets, const LzssBatchSettings& settings) {
+    RunBatch(inputs, count, output, offsets, settings, false);
+}
+
+void DecompressBatch(const std::vector<uint8_t>& input, const std::vector<size_t>& inputOffsets,
+                     std::vector<uint8_t>& output, std::vector<size_t>& offsets,
+                     const LzssBatchSettings& settings) {
+    std::vector<LzssSpan> spans(inputOffsets.empty() ? 0 : inputOffsets.size() - 1);
+    for (size_t i = 0; i < spans.size(); i++) {
+        if (inputOffsets[i] > inputOffsets[i + 1] || inputOffsets[i + 1] > input.size()) {
+            throw std::out_of_range("Batch offsets outside the input");
+        }
+        spans[i] = { input.data() + inputOffsets[i], inputOffsets[i + 1] - inputOffsets[i] };
+    }
+    DecompressBatch(spans.data(), spans.size(), output, offsets, settings);
+}
+
+} // namespace Compression
@@ -0,0 +1,49 @@
+#pragma once
+#ifndef LZSS_BATCH_HPP
+#define LZSS_BATCH_HPP
+
+#include "Lzss.hpp"
+
+namespace Compression {
+
+// Batch codec for many small independent records. Each record is coded as
+// its own plain LZSS stream, byte for byte what CompressData() produces for
+// it, and the results are concatenated: record i occupies
+// output[offsets[i], offsets[i + 1]), with offsets holding count + 1
+// entries. Each worker builds one codec and resets it between records, so
+// the cost per record follows the record's size rather than the window's.
+//
+// Records are split into contiguous runs of similar total size, one per
+// worker; each worker writes its own part of the output, and the parts are
+// joined in order once all have finished. With stats set in the codec
+// settings, every worker counts into its own LzssStats and the totals are
+// added to it at the end.
+struct LzssBatchSettings {
+    // Settings of the LZSS codec run on every record
+    LzssSettings codec;
+    // Worker threads; 0 uses one per hardware thread
+    size_t threadCount = 1;
+};
+
+// One input record
+struct LzssSpan {
+    const uint8_t* data;
+    size_t size;
+};
+
+// Compresses count records into output and offsets (replacing their contents)
+void CompressBatch(const LzssSpan* inputs, size_t count, std::vector<uint8_t>& output,
+                   std::vector<size_t>& offsets, const LzssBatchSettings& settings = LzssBatchSettings());
+
+// Decodes count records, each a complete LZSS stream, into output and offsets
+// (replacing their contents)
+void DecompressBatch(const LzssSpan* inputs, size_t count, std::vector<uint8_t>& output,
+                     std::vector<size_t>& offsets, const LzssBatchSettings& settings = LzssBatchSettings());
+// Same, for records laid out as CompressBatch() returns them
+void DecompressBatch(const std::vector<uint8_t>& input, const std::vector<size_t>& inputOffsets,
+                     std::vector<uint8_t>& output, std::vector<size_t>& offsets,
+                     const LzssBatchSettings& settings = LzssBatchSettings());
+
+} // namespace Compression
+
+#endif // LZSS_BATCH_HPP
@@ -0,0 +1,198 @@
+#include "LzssChecksum.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define LZSS_CRC32C_SSE42 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define LZSS_CRC32C_ARM 1
+#endif
+
+namespace Compression {
+
+namespace {
+
+// Reflected CRC-32C polynomial
+const uint32_t kPolynomial = 0x82f63b78u;
+
+uint32_t Load32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 |
+           static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+}
+
+// Operators over GF(2) as 32 columns, column n being the image of bit n
+uint32_t MatrixTimes(const uint32_t* matrix, uint32_t vector) {
+    uint32_t sum = 0;
+    for (; vector != 0; vector >>= 1, matrix++) {
+        if ((vector & 1) != 0) {
+            sum ^= *matrix;
+        }
+    }
+    return sum;
+}
+
+void MatrixSquare(uint32_t* square, const uint32_t* matrix) {
+    for (int n = 0; n < 32; n++) {
+        square[n] = MatrixTimes(matrix, matrix[n]);
+    }
+}
+
+struct Crc32cTables {
+    // Slice-by-8 tables of the software loop
+    uint32_t slice[8][256];
+    // Byte-wise tables of the operator that appends kLongLane or
+    // kShortLane zero bytes to a CRC register, for joining the three lanes
+    // of the hardware loop
+    uint32_t longShift[4][256];
+    uint32_t shortShift[4][256];
+
+    Crc32cTables() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t crc = n;
+            for (int k = 0; k < 8; k++) {
+                crc = (crc & 1) != 0 ? (crc >> 1) ^ kPolynomial : crc >> 1;
+            }
+            slice[0][n] = crc;
+        }
+        for (uint32_t n = 0; n < 256; n++) {
+            for (int k = 1; k < 8; k++) {
+                slice[k][n] = (slice[k - 1][n] >> 8) ^ slice[0][slice[k - 1][n] & 0xff];
+            }
+        }
+        BuildShift(longShift, kLongLane);
+        BuildShift(shortShift, kShortLane);
+    }
+
+    // Squares the one-zero-bit operator up to length zero bytes; length is a
+    // power of two
+    static void BuildShift(uint32_t (&shift)[4][256], size_t length) {
+        uint32_t op[32];
+        uint32_t square[32];
+        op[0] = kPolynomial;
+        for (int n = 1; n < 32; n++) {
+            op[n] = 1u << (n - 1);
+        }
+        for (size_t bits = 1; bits < length * 8; bits *= 2) {
+            MatrixSquare(square, op);
+            std::memcpy(op, square, sizeof(op));
+        }
+        for (uint32_t n = 0; n < 256; n++) {
+            for (int k = 0; k < 4; k++) {
+                shift[k][n] = MatrixTimes(op, n << (8 * k));
+            }
+        }
+    }
+
+    static const size_t kLongLane = 8192;
+    static const size_t kShortLane = 256;
+};
+
+const Crc32cTables& Tables() {
+    static const Crc32cTables tables;
+    return tables;
+}
+
+// Works on the inverted register, like the hardware variants
+uint32_t Crc32cSoftware(const uint8_t* data, size_t size, uint32_t crc) {
+    const Crc32cTables& t = Tables();
+    for (; size >= 8; data += 8, size -= 8) {
+        crc ^= Load32(data);
+        uint32_t high = Load32(data + 4);
+        crc = t.slice[7][crc & 0xff] ^ t.slice[6][(crc >> 8) & 0xff] ^
+              t.slice[5][(crc >> 16) & 0xff] ^ t.slice[4][crc >> 24] ^
+              t.slice[3][high & 0xff] ^ t.slice[2][(high >> 8) & 0xff] ^
+              t.slice[1][(high >> 16) & 0xff] ^ t.slice[0][high >> 24];
+    }
+    for (; size > 0; data++, size--) {
+        crc = (crc >> 8) ^ t.slice[0][(crc ^ *data) & 0xff];
+    }
+    return crc;
+}
+
+#if defined(LZSS_CRC32C_SSE42)
+
+uint32_t Shift(const uint32_t (*shift)[256], uint32_t crc) {
+    return shift[0][crc & 0xff] ^ shift[1][(crc >> 8) & 0xff] ^ shift[2][(crc >> 16) & 0xff] ^ shift[3][crc >> 24];
+}
+
+// The CRC32 instruction has a latency of three cycles but issues every
+// cycle, so three independent lanes are run side by side and joined by
+// shifting the earlier lanes over the later ones
+__attribute__((target("sse4.2")))
+uint32_t Crc32cHardware(const uint8_t* data, size_t size, uint32_t crc) {
+    const Crc32cTables& t = Tables();
+    uint64_t crc0 = crc;
+    for (; size > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0; data++, size--) {
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *data);
+    }
+    const size_t laneSizes[2] = { Crc32cTables::kLongLane, Crc32cTables::kShortLane };
+    const uint32_t (*shifts[2])[256] = { t.longShift, t.shortShift };
+    for (int pass = 0; pass < 2; pass++) {
+        const size_t lane = laneSizes[pass];
+        while (size >= lane * 3) {
+            uint64_t crc1 = 0;
+            uint64_t crc2 = 0;
+            for (const uint8_t* end = data + lane; data < end; data += 8) {
+                uint64_t word0, word1, word2;
+                std::memcpy(&word0, data, 8);
+                std::memcpy(&word1, data + lane, 8);
+                std::memcpy(&word2, data + lane * 2, 8);
+                crc0 = _mm_crc32_u64(crc0, word0);
+                crc1 = _mm_crc32_u64(crc1, word1);
+                crc2 = _mm_crc32_u64(crc2, word2);
+            }
+            crc0 = Shift(shifts[pass], static_cast<uint32_t>(crc0)) ^ crc1;
+            crc0 = Shift(shifts[pass], static_cast<uint32_t>(crc0)) ^ crc2;
+            data += lane * 2;
+            size -= lane * 3;
+        }
+    }
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        crc0 = _mm_crc32_u64(crc0, word);
+    }
+    for (; size > 0; data++, size--) {
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *data);
+    }
+    return static_cast<uint32_t>(crc0);
+}
+
+bool HasHardwareCrc() {
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+}
+
+#elif defined(LZSS_CRC32C_ARM)
+
+uint32_t Crc32cHardware(const uint8_t* data, size_t size, uint32_t crc) {
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        crc = __crc32cd(crc, word);
+    }
+    for (; size > 0; data++, size--) {
+        crc = __crc32cb(crc, *data);
+    }
+    return crc;
+}
+
+bool HasHardwareCrc() {
+    return true;
+}
+
+#endif
+
+} // namespace
+
+uint32_t Crc32c(const uint8_t* data, size_t size, uint32_t crc) {
+#if defined(LZSS_CRC32C_SSE42) || defined(LZSS_CRC32C_ARM)
+    if (HasHardwareCrc()) {
+        return ~Crc32cHardware(data, size, ~crc);
+    }
+#endif
+    return ~Crc32cSoftware(data, size, ~crc);
+}
+
+} // namespace Compression
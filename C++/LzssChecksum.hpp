@@ -0,0 +1,19 @@
+#pragma once
+#ifndef LZSS_CHECKSUM_HPP
+#define LZSS_CHECKSUM_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Compression {
+
+// CRC-32C (Castagnoli) as used by iSCSI, ext4 and SSE4.2; "123456789" gives
+// 0xE3069283. Pass the result of a previous call as crc to continue it over
+// the next piece of the same data. Uses the CRC32 instructions of SSE4.2
+// (checked at run time) or ARMv8 where available, a table-driven loop
+// otherwise.
+uint32_t Crc32c(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+} // namespace Compression
+
+#endif // LZSS_CHECKSUM_HPP
@@ -1,15 +1,527 @@
 #include "Lzss.hpp"
 #include <stdexcept>
-#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LZSS_MATCH_SSE2 1
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define LZSS_MATCH_NEON 1
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define LZSS_MATCH_AVX2 1
+#endif
 
 namespace Compression {
 
+namespace {
+
+// Pulls the input stream in blocks of ioBufferSize bytes so the codec loops
+// only ever touch a raw pointer into the chunk.
+class StreamReader {
+public:
+    StreamReader(std::istream& stream, int32_t chunkSize, std::pmr::memory_resource* resource)
+        : stream_(stream)
+        , chunk_(std::max<int32_t>(chunkSize, 1), resource)
+        , pos_(chunk_.data())
+        , end_(chunk_.data())
+        , filled_(0)
+    {
+    }
+
+    int32_t Get() {
+        if (pos_ == end_ && !Fill()) {
+            return std::char_traits<char>::eof();
+        }
+        return *pos_++;
+    }
+
+    // Bytes that can be read without going back to the stream
+    size_t Available() const {
+        return end_ - pos_;
+    }
+
+    // Direct access to the Available() bytes, for decoders that parse whole
+    // runs of tokens at once
+    const uint8_t* Data() const {
+        return pos_;
+    }
+
+    void Skip(size_t size) {
+        pos_ += size;
+    }
+
+    uint64_t Consumed() const {
+        return filled_ - (end_ - pos_);
+    }
+
+private:
+    bool Fill() {
+        stream_.read(reinterpret_cast<char*>(chunk_.data()), chunk_.size());
+        pos_ = chunk_.data();
+        end_ = pos_ + stream_.gcount();
+        filled_ += end_ - pos_;
+        return pos_ != end_;
+    }
+
+    std::istream& stream_;
+    std::pmr::vector<uint8_t> chunk_;
+    const uint8_t* pos_;
+    const uint8_t* end_;
+    uint64_t filled_;
+};
+
+// Collects output into blocks of ioBufferSize bytes and hands each block to
+// the stream with a single write.
+class StreamWriter {
+public:
+    StreamWriter(std::ostream& stream, int32_t chunkSize, std::pmr::memory_resource* resource)
+        : stream_(stream)
+        , chunk_(std::max<int32_t>(chunkSize, 1), resource)
+        , pos_(chunk_.data())
+        , end_(chunk_.data() + chunk_.size())
+        , flushed_(0)
+    {
+    }
+
+    ~StreamWriter() {
+        Flush();
+    }
+
+    void Put(uint8_t value) {
+        if (pos_ == end_) {
+            Flush();
+        }
+        *pos_++ = value;
+    }
+
+    void Write(const uint8_t* data, size_t size) {
+        if (static_cast<size_t>(end_ - pos_) < size) {
+            Flush();
+            if (size >= chunk_.size()) {
+                stream_.write(reinterpret_cast<const char*>(data), size);
+                flushed_ += size;
+                return;
+            }
+        }
+        std::copy(data, data + size, pos_);
+        pos_ += size;
+    }
+
+    void Flush() {
+        if (pos_ != chunk_.data()) {
+            stream_.write(reinterpret_cast<const char*>(chunk_.data()), pos_ - chunk_.data());
+            flushed_ += pos_ - chunk_.data();
+            pos_ = chunk_.data();
+        }
+    }
+
+    uint64_t Written() const {
+        return flushed_ + (pos_ - chunk_.data());
+    }
+
+private:
+    std::ostream& stream_;
+    std::pmr::vector<uint8_t> chunk_;
+    uint8_t* pos_;
+    uint8_t* const end_;
+    uint64_t flushed_;
+};
+
+// Reads straight out of a caller-provided memory range.
+class MemoryReader {
+public:
+    MemoryReader(const uint8_t* data, size_t size)
+        : begin_(data)
+        , pos_(data)
+        , end_(data + size)
+    {
+    }
+
+    int32_t Get() {
+        if (pos_ == end_) {
+            return std::char_traits<char>::eof();
+        }
+        return *pos_++;
+    }
+
+    size_t Available() const {
+        return end_ - pos_;
+    }
+
+    const uint8_t* Data() const {
+        return pos_;
+    }
+
+    void Skip(size_t size) {
+        pos_ += size;
+    }
+
+    uint64_t Consumed() const {
+        return pos_ - begin_;
+    }
+
+private:
+    const uint8_t* begin_;
+    const uint8_t* pos_;
+    const uint8_t* end_;
+};
+
+// Appends to a caller-owned vector.
+class VectorWriter {
+public:
+    explicit VectorWriter(std::vector<uint8_t>& output)
+        : output_(output)
+        , start_(output.size())
+    {
+    }
+
+    void Put(uint8_t value) {
+        output_.push_back(value);
+    }
+
+    void Write(const uint8_t* data, size_t size) {
+        output_.insert(output_.end(), data, data + size);
+    }
+
+    void Flush() {}
+
+    uint64_t Written() const {
+        return output_.size() - start_;
+    }
+
+private:
+    std::vector<uint8_t>& output_;
+    size_t start_;
+};
+
+// Writes into a fixed caller-provided buffer.
+class BufferWriter {
+public:
+    BufferWriter(uint8_t* data, size_t capacity)
+        : begin_(data)
+        , pos_(data)
+        , end_(data + capacity)
+    {
+    }
+
+    void Put(uint8_t value) {
+        if (pos_ == end_) {
+            throw std::length_error("Output buffer too small");
+        }
+        *pos_++ = value;
+    }
+
+    void Write(const uint8_t* data, size_t size) {
+        if (static_cast<size_t>(end_ - pos_) < size) {
+            throw std::length_error("Output buffer too small");
+        }
+        std::copy(data, data + size, pos_);
+        pos_ += size;
+    }
+
+    void Flush() {}
+
+    size_t Size() const {
+        return pos_ - begin_;
+    }
+
+    uint64_t Written() const {
+        return Size();
+    }
+
+private:
+    uint8_t* begin_;
+    uint8_t* pos_;
+    uint8_t* end_;
+};
+
+// Adds the wall time of its scope to one of the clocks of stats, if any
+class PhaseTimer {
+public:
+    PhaseTimer(LzssStats* stats, std::chrono::nanoseconds LzssStats::*clock)
+        : stats_(stats)
+        , clock_(clock)
+    {
+        if (stats_ != nullptr) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~PhaseTimer() {
+        if (stats_ != nullptr) {
+            stats_->*clock_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start_);
+        }
+    }
+
+private:
+    LzssStats* stats_;
+    std::chrono::nanoseconds LzssStats::*clock_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Copies a back-reference that starts at least Step bytes behind its
+// destination with fixed-size unaligned copies. Each copy only reads bytes
+// that are already in place, so this matches the byte-by-byte semantics, but
+// it may write up to Step - 1 bytes past length.
+template <size_t Step>
+inline void WideCopy(uint8_t* dst, const uint8_t* src, size_t length) {
+    for (size_t k = 0; k < length; k += Step) {
+        std::memcpy(dst + k, src + k, Step);
+    }
+}
+
+// Copies a back-reference whose source starts before dst without writing
+// past length. Overlapping sources are copied in chunks no longer than the
+// distance, so every chunk reads bytes that are already in place; the last
+// chunk ends exactly at length and may rewrite bytes of the one before.
+inline void CopyMatch(uint8_t* dst, const uint8_t* src, size_t length) {
+    const size_t back = dst - src;
+    if (back >= 8 && length >= 8) {
+        for (size_t k = 0; k + 8 < length; k += 8) {
+            std::memcpy(dst + k, src + k, 8);
+        }
+        std::memcpy(dst + length - 8, src + length - 8, 8);
+    } else if (back == 1) {
+        std::memset(dst, src[0], length);
+    } else {
+        for (size_t k = 0; k < length; k++) {
+            dst[k] = src[k];
+        }
+    }
+}
+
+// Number of leading bytes a and b have in common, at most limit. Never reads
+// past a + limit or b + limit.
+inline int32_t MatchLengthScalar(const uint8_t* a, const uint8_t* b, int32_t limit) {
+    int32_t i = 0;
+#if defined(__GNUC__) || defined(__clang__)
+    for (; i + 8 <= limit; i += 8) {
+        uint64_t x, y;
+        std::memcpy(&x, a + i, 8);
+        std::memcpy(&y, b + i, 8);
+        if (x != y) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return i + (__builtin_ctzll(x ^ y) >> 3);
+#else
+            return i + (__builtin_clzll(x ^ y) >> 3);
+#endif
+        }
+    }
+#endif
+    while (i < limit && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+#if LZSS_MATCH_AVX2
+// 32 bytes per step; only called when the CPU reports AVX2
+__attribute__((target("avx2")))
+int32_t MatchLengthAvx2(const uint8_t* a, const uint8_t* b, int32_t limit) {
+    int32_t i = 0;
+    for (; i + 32 <= limit; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        uint32_t diff = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+        if (diff != 0) {
+            return i + __builtin_ctz(diff);
+        }
+    }
+    return i + MatchLengthScalar(a + i, b + i, limit - i);
+}
+
+const bool hasAvx2 = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+}();
+#endif
+
+// Vector compare for the match finders: one 16-byte compare plus a count of
+// trailing zeros finds the first mismatch. Long limits switch to AVX2 when
+// the CPU has it; the scalar loop covers the tail and other targets.
+inline int32_t MatchLength(const uint8_t* a, const uint8_t* b, int32_t limit) {
+#if LZSS_MATCH_AVX2
+    if (limit >= 64 && hasAvx2) {
+        return MatchLengthAvx2(a, b, limit);
+    }
+#endif
+    int32_t i = 0;
+#if LZSS_MATCH_SSE2
+    for (; i + 16 <= limit; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        uint32_t diff = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) ^ 0xFFFFu;
+        if (diff != 0) {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long bit;
+            _BitScanForward(&bit, diff);
+            return i + static_cast<int32_t>(bit);
+#else
+            return i + __builtin_ctz(diff);
+#endif
+        }
+    }
+#elif LZSS_MATCH_NEON
+    for (; i + 16 <= limit; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        // Narrow each byte lane to a nibble so the mask fits in 64 bits
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        if (mask != ~uint64_t(0)) {
+            return i + (__builtin_ctzll(~mask) >> 2);
+        }
+    }
+#endif
+    return i + MatchLengthScalar(a + i, b + i, limit - i);
+}
+
+// Window shape read from the settings at run time
+struct RuntimeShape {
+    explicit RuntimeShape(const LzssSettings& settings)
+        : frameSize(settings.frameSize)
+        , maxMatchLength(settings.maxMatchLength)
+        , minMatchLength(settings.minMatchLength)
+        , wideTokens(GetTokenFormat(settings) == LzssTokenFormat::Wide)
+    {
+    }
+
+    int32_t frameSize;
+    int32_t maxMatchLength;
+    int32_t minMatchLength;
+    bool wideTokens;
+};
+
+// Window shape known at compile time, so masks fold to constants and the
+// match compare loops have a fixed trip count
+template <int32_t FrameSize, int32_t MaxMatchLength, int32_t MinMatchLength>
+struct FixedShape {
+    static constexpr int32_t frameSize = FrameSize;
+    static constexpr int32_t maxMatchLength = MaxMatchLength;
+    static constexpr int32_t minMatchLength = MinMatchLength;
+    static constexpr bool wideTokens = FrameSize > 0x1000 || MaxMatchLength > MinMatchLength + 16;
+};
+
+// The prebuilt specialization; every other shape runs the generic loops
+using DefaultShape = FixedShape<0x1000, 0x12, 2>;
+
+template <typename Fn>
+void DispatchShape(const LzssSettings& settings, Fn&& fn) {
+    if (settings.frameSize == DefaultShape::frameSize &&
+        settings.maxMatchLength == DefaultShape::maxMatchLength &&
+        settings.minMatchLength == DefaultShape::minMatchLength) {
+        fn(DefaultShape());
+    } else {
+        fn(RuntimeShape(settings));
+    }
+}
+
+// Bytes of input a whole flag group can take: the flag byte and eight
+// matches
+template <typename Shape>
+constexpr size_t GroupInputSize(Shape shape) {
+    return 1 + 8 * (shape.wideTokens ? 3 : 2);
+}
+
+// Longest match a token can encode. Streams from the compressor stop at
+// maxMatchLength, but a malformed one may use the whole length field, so
+// output bounds are sized from this
+template <typename Shape>
+constexpr size_t LongestMatch(Shape shape) {
+    return shape.minMatchLength + (shape.wideTokens ? 256 : 16);
+}
+
+// Splits the match token at token into its window position and its length in
+// bytes
+template <typename Shape>
+inline void ParseMatch(Shape shape, const uint8_t* token, size_t& position, size_t& length) {
+    if (shape.wideTokens) {
+        position = token[0] | (token[1] << 8);
+        length = token[2] + shape.minMatchLength + 1;
+    } else {
+        position = token[0] | ((token[1] & 0xf0) << 4);
+        length = (token[1] & 0x0f) + shape.minMatchLength + 1;
+    }
+}
+
+struct LevelPreset {
+    LzssMatchFinder matchFinder;
+    int32_t chainDepth;
+    bool lazyMatching;
+    bool optimalParsing;
+};
+
+const LevelPreset kLevelPresets[] = {
+    { LzssMatchFinder::HashChain, 1, false, false },
+    { LzssMatchFinder::HashChain, 4, false, false },
+    { LzssMatchFinder::HashChain, 8, true, false },
+    { LzssMatchFinder::HashChain, 32, true, false },
+    { LzssMatchFinder::HashChain, 128, true, false },
+    { LzssMatchFinder::BinaryTree, 0, false, false },
+    { LzssMatchFinder::BinaryTree, 0, true, false },
+    { LzssMatchFinder::BinaryTree, 0, false, true },
+};
+
+// Positions optimal parsing collects before it encodes them
+const size_t kParseBlockSize = 0x4000;
+
+// Hash heads keep the position, up to frameSize, in their low bits and the
+// stream stamp above it
+const int32_t kStampShift = 17;
+const uint32_t kHeadMask = (1u << kStampShift) - 1;
+const uint32_t kStampLimit = 1u << (32 - kStampShift);
+
+LzssSettings ApplyCompressionLevel(LzssSettings settings) {
+    if (settings.memoryResource == nullptr) {
+        settings.memoryResource = std::pmr::get_default_resource();
+    }
+    const int32_t levels = sizeof(kLevelPresets) / sizeof(kLevelPresets[0]);
+    if (settings.compressionLevel < 0 || settings.compressionLevel > levels) {
+        throw std::invalid_argument("Unsupported compression level");
+    }
+    GetTokenFormat(settings);
+    if (settings.compressionLevel > 0) {
+        const LevelPreset& preset = kLevelPresets[settings.compressionLevel - 1];
+        settings.matchFinder = preset.matchFinder;
+        settings.lazyMatching = preset.lazyMatching;
+        settings.optimalParsing = preset.optimalParsing;
+        if (preset.chainDepth > 0) {
+            settings.chainDepth = preset.chainDepth;
+        }
+    }
+    return settings;
+}
+
+} // namespace
+
 LzssCompression::LzssCompression(std::istream& input, std::ostream& output, bool compress, const LzssSettings& settings)
-    : input_(input)
-    , output_(output)
+    : LzssCompression(compress, settings)
+{
+    input_ = &input;
+    output_ = &output;
+}
+
+LzssCompression::LzssCompression(bool compress, const LzssSettings& settings)
+    : input_(nullptr)
+    , output_(nullptr)
     , isCompress_(compress)
-    , settings_(settings)
-    , buffer_(settings.frameSize + settings.maxMatchLength - 1)
+    , settings_(ApplyCompressionLevel(settings))
+    , buffer_(settings.frameSize + settings.maxMatchLength - 1, settings_.memoryResource)
+    , narrowTree_(settings_.memoryResource)
+    , wideTree_(settings_.memoryResource)
+    , hashHeads_(settings_.memoryResource)
+    , hashChain_(settings_.memoryResource)
+    , hashStamp_(0)
+    , parse_(settings_.memoryResource)
+    , encoder_()
+    , decoder_()
+    , initialFramePos_(settings.frameInitPos)
+    , windowAdvance_(0)
 {
     if (settings.frameFill != 0) {
         std::fill(buffer_.begin(), buffer_.begin() + settings.frameSize, settings.frameFill);
@@ -18,265 +530,1226 @@ LzssCompression::LzssCompression(std::istream& input, std::ostream& output, bool
     if (isCompress_) {
         InitCompress();
     }
+    if (settings_.dictionary != nullptr) {
+        const LzssSettings& primed = settings_.dictionary->primed_->settings_;
+        if (primed.frameSize != settings_.frameSize || primed.maxMatchLength != settings_.maxMatchLength ||
+            primed.minMatchLength != settings_.minMatchLength || primed.frameInitPos != settings_.frameInitPos ||
+            primed.frameFill != settings_.frameFill ||
+            (isCompress_ && primed.matchFinder != settings_.matchFinder)) {
+            throw std::invalid_argument("Dictionary was built for other settings");
+        }
+        LoadDictionary();
+    }
 }
 
 LzssCompression::~LzssCompression() = default;
 
+size_t LzssCompression::WorkingMemorySize(const LzssSettings& settings, bool compress) {
+    const LzssSettings resolved = ApplyCompressionLevel(settings);
+    size_t size = resolved.frameSize + resolved.maxMatchLength - 1;
+    if (compress) {
+        if (resolved.matchFinder == LzssMatchFinder::HashChain) {
+            size += (resolved.frameSize * 2 + resolved.frameSize) * sizeof(int32_t);
+        } else {
+            size += (resolved.frameSize + 257) * (resolved.frameSize + 256 <= UINT16_MAX
+                ? sizeof(TreeNode<uint16_t>) : sizeof(TreeNode<int32_t>));
+        }
+        if (resolved.optimalParsing) {
+            size += (kParseBlockSize + 1) * sizeof(ParseStep);
+        }
+    }
+    return size;
+}
+
 void LzssCompression::InitCompress() {
-    leftChildren_.resize(settings_.frameSize + 1);
-    rightChildren_.resize(settings_.frameSize + 257);
-    parents_.resize(settings_.frameSize + 1);
+    if (settings_.matchFinder == LzssMatchFinder::HashChain) {
+        hashHeads_.resize(settings_.frameSize * 2);
+        hashChain_.resize(settings_.frameSize);
+    } else {
+        if (settings_.frameSize + 256 <= UINT16_MAX) {
+            narrowTree_.resize(settings_.frameSize + 257);
+        } else {
+            wideTree_.resize(settings_.frameSize + 257);
+        }
+    }
+    if (settings_.optimalParsing) {
+        parse_.resize(kParseBlockSize + 1);
+    }
     matchLength_ = 0;
     matchPosition_ = 0;
 }
 
+// Opens a new compressed stream at the initial window position. The window
+// slots and match finder an earlier stream left behind are restored first,
+// so every stream starts from the state a fresh codec has.
+void LzssCompression::BeginStream() {
+    if (!isCompress_) {
+        throw std::runtime_error("Not in compression mode");
+    }
+    PhaseTimer timer(settings_.stats, &LzssStats::initTime);
+    if (settings_.dictionary != nullptr) {
+        LoadDictionary();
+    } else {
+        InitTree();
+        RestoreWindow();
+    }
+    windowAdvance_ = 0;
+    encoder_.r = settings_.frameInitPos;
+    encoder_.s = (settings_.frameInitPos + settings_.maxMatchLength) & (settings_.frameSize - 1);
+    encoder_.len = 0;
+    encoder_.pending = 0;
+    encoder_.parsed = 0;
+    encoder_.fresh = settings_.dictionary == nullptr
+        ? std::max(0, settings_.frameSize - 2 * settings_.maxMatchLength) : 0;
+    encoder_.active = true;
+    encoder_.started = false;
+    encoder_.filling = true;
+    encoder_.mask = 1;
+    encoder_.codeBufPtr = 1;
+    encoder_.codeBufSent = 0;
+    encoder_.codeBuf[0] = 0;
+}
+
+// Places the tail of data in the window before frameInitPos and inserts
+// every position whose match key lies entirely inside it. The last
+// maxMatchLength positions are inserted when a stream starts, as for a
+// window without a dictionary, once the lookahead they reach into is known.
+void LzssCompression::Prime(const uint8_t* data, size_t size) {
+    const int32_t mask = settings_.frameSize - 1;
+    const int32_t keep = static_cast<int32_t>(
+        std::min<size_t>(size, settings_.frameSize - settings_.maxMatchLength));
+    const int32_t start = settings_.frameInitPos - keep;
+    data += size - keep;
+    for (int32_t k = 0; k < keep; k++) {
+        int32_t pos = (start + k) & mask;
+        buffer_[pos] = data[k];
+        if (pos < settings_.maxMatchLength - 1) {
+            buffer_[pos + settings_.frameSize] = data[k];
+        }
+    }
+
+    InitTree();
+    // Streams that start from a dictionary delete every slot they reach, so
+    // the slots it leaves out have to read as unused
+    if (!narrowTree_.empty()) {
+        ClearTree(narrowTree_.data(), 0, settings_.frameSize);
+    } else if (!wideTree_.empty()) {
+        ClearTree(wideTree_.data(), 0, settings_.frameSize);
+    }
+    DispatchShape(settings_, [&](auto shape) {
+        for (int32_t k = 0; k < keep - shape.maxMatchLength; k++) {
+            InsertString(shape, (start + k) & mask);
+        }
+    });
+}
+
+// Copies the primed window, and for a compressor the match finder, out of
+// the dictionary
+void LzssCompression::LoadDictionary() {
+    const LzssCompression& primed = *settings_.dictionary->primed_;
+    std::copy(primed.buffer_.begin(), primed.buffer_.end(), buffer_.begin());
+    if (isCompress_) {
+        narrowTree_ = primed.narrowTree_;
+        wideTree_ = primed.wideTree_;
+        hashHeads_ = primed.hashHeads_;
+        hashChain_ = primed.hashChain_;
+        hashStamp_ = primed.hashStamp_;
+    }
+}
+
+LzssDictionary::LzssDictionary(const uint8_t* data, size_t size, const LzssSettings& settings) {
+    LzssSettings primed = settings;
+    primed.dictionary = nullptr;
+    primed_.reset(new LzssCompression(true, primed));
+    primed_->Prime(data, size);
+}
+
+LzssDictionary::~LzssDictionary() = default;
+
+// Number of window slots, starting maxMatchLength before initialFramePos_,
+// that may have been written since the last reset. Spans of half the window
+// or more are treated as the whole window, which one fill restores faster.
+int32_t LzssCompression::DirtySpan() const {
+    uint64_t span = windowAdvance_ + 2 * settings_.maxMatchLength + 1;
+    return span < static_cast<uint64_t>(settings_.frameSize / 2) ? static_cast<int32_t>(span) : settings_.frameSize;
+}
+
+// Empties the match finder for a new stream without touching window slots:
+// the hash heads of earlier streams go stale with the stamp, tree nodes are
+// only read once the stream has inserted them
 void LzssCompression::InitTree() {
+    if (settings_.matchFinder == LzssMatchFinder::HashChain) {
+        if (++hashStamp_ == kStampLimit) {
+            std::fill(hashHeads_.begin(), hashHeads_.end(), 0);
+            hashStamp_ = 1;
+        }
+        return;
+    }
+    if (!narrowTree_.empty()) {
+        ClearTree(narrowTree_.data(), 0, 0);
+    } else {
+        ClearTree(wideTree_.data(), 0, 0);
+    }
+}
+
+// Empties all 256 trees and marks span window positions from begin unused
+template <typename Node>
+void LzssCompression::ClearTree(Node* tree, int32_t begin, int32_t span) {
+    const int32_t mask = settings_.frameSize - 1;
     for (int32_t i = settings_.frameSize + 1; i <= settings_.frameSize + 256; i++) {
-        rightChildren_[i] = settings_.frameSize;
+        tree[i].right = settings_.frameSize;
     }
-    for (int32_t i = 0; i < settings_.frameSize; i++) {
-        parents_[i] = settings_.frameSize;
+    for (int32_t i = 0; i < span; i++) {
+        tree[(begin + i) & mask].parent = settings_.frameSize;
     }
 }
 
-void LzssCompression::InsertNode(int32_t r) {
+// Refills the window slots written since the last reset with frameFill
+void LzssCompression::RestoreWindow() {
+    const int32_t mask = settings_.frameSize - 1;
+    const int32_t span = DirtySpan();
+    const int32_t begin = initialFramePos_ - settings_.maxMatchLength;
+
+    if (span == settings_.frameSize) {
+        std::fill(buffer_.begin(), buffer_.begin() + settings_.frameSize, settings_.frameFill);
+    } else {
+        for (int32_t i = 0; i < span; i++) {
+            buffer_[(begin + i) & mask] = settings_.frameFill;
+        }
+    }
+    std::fill(buffer_.begin() + settings_.frameSize, buffer_.end(), 0);
+}
+
+void LzssCompression::Reset() {
+    // A compressor restores its window and match finder, or reloads the
+    // dictionary, when its next stream starts
+    if (!isCompress_) {
+        PhaseTimer timer(settings_.stats, &LzssStats::initTime);
+        if (settings_.dictionary != nullptr) {
+            LoadDictionary();
+        } else {
+            RestoreWindow();
+        }
+        windowAdvance_ = 0;
+    }
+
+    settings_.frameInitPos = initialFramePos_;
+    matchLength_ = 0;
+    matchPosition_ = 0;
+    encoder_.active = false;
+    decoder_ = DecoderState();
+}
+
+void LzssCompression::Reset(std::istream& input, std::ostream& output) {
+    Reset();
+    input_ = &input;
+    output_ = &output;
+}
+
+template <typename Shape, typename Node>
+int32_t LzssCompression::InsertTreeNode(Shape shape, Node* tree, int32_t r) {
+    const int32_t nil = shape.frameSize;
     int32_t i = 0;
-    int32_t p = settings_.frameSize + 1 + buffer_[r];
+    int32_t p = nil + 1 + buffer_[r];
     int32_t cmp = 1;
-    rightChildren_[r] = leftChildren_[r] = settings_.frameSize;
+    int32_t steps = 0;
+    tree[r].right = tree[r].left = nil;
     matchLength_ = 0;
 
     while (true) {
         if (cmp >= 0) {
-            if (rightChildren_[p] != settings_.frameSize) {
-                p = rightChildren_[p];
+            if (tree[p].right != nil) {
+                p = tree[p].right;
             } else {
-                rightChildren_[p] = r;
-                parents_[r] = p;
-                return;
+                tree[p].right = r;
+                tree[r].parent = p;
+                return steps;
             }
         } else {
-            if (leftChildren_[p] != settings_.frameSize) {
-                p = leftChildren_[p];
+            if (tree[p].left != nil) {
+                p = tree[p].left;
             } else {
-                leftChildren_[p] = r;
-                parents_[r] = p;
-                return;
+                tree[p].left = r;
+                tree[r].parent = p;
+                return steps;
             }
         }
+        steps++;
 
-        for (i = 1; i < settings_.maxMatchLength; i++) {
-            if ((cmp = buffer_[r + i] - buffer_[p + i]) != 0) {
-                break;
-            }
-        }
+        i = 1 + MatchLength(&buffer_[r + 1], &buffer_[p + 1], shape.maxMatchLength - 1);
+        cmp = i < shape.maxMatchLength ? buffer_[r + i] - buffer_[p + i] : 0;
 
         if (i > matchLength_) {
             matchPosition_ = p;
-            if ((matchLength_ = i) >= settings_.maxMatchLength) {
+            if ((matchLength_ = i) >= shape.maxMatchLength) {
                 break;
             }
         }
     }
-    parents_[r] = parents_[p];
-    leftChildren_[r] = leftChildren_[p];
-    rightChildren_[r] = rightChildren_[p];
-    parents_[leftChildren_[p]] = r;
-    parents_[rightChildren_[p]] = r;
-    if (rightChildren_[parents_[p]] == p) {
-        rightChildren_[parents_[p]] = r;
+    tree[r].parent = tree[p].parent;
+    tree[r].left = tree[p].left;
+    tree[r].right = tree[p].right;
+    tree[tree[p].left].parent = r;
+    tree[tree[p].right].parent = r;
+    if (tree[tree[p].parent].right == p) {
+        tree[tree[p].parent].right = r;
     } else {
-        leftChildren_[parents_[p]] = r;
+        tree[tree[p].parent].left = r;
     }
-    parents_[p] = settings_.frameSize;
+    tree[p].parent = nil;
+    return steps;
 }
 
-void LzssCompression::DeleteNode(int32_t p) {
+template <typename Shape, typename Node>
+bool LzssCompression::DeleteTreeNode(Shape shape, Node* tree, int32_t p) {
+    const int32_t nil = shape.frameSize;
     int32_t q;
     
-    if (parents_[p] == settings_.frameSize) {
-        return;
+    if (tree[p].parent == nil) {
+        return false;
     }
     
-    if (rightChildren_[p] == settings_.frameSize) {
-        q = leftChildren_[p];
-    } else if (leftChildren_[p] == settings_.frameSize) {
-        q = rightChildren_[p];
+    if (tree[p].right == nil) {
+        q = tree[p].left;
+    } else if (tree[p].left == nil) {
+        q = tree[p].right;
     } else {
-        q = leftChildren_[p];
-        if (rightChildren_[q] != settings_.frameSize) {
+        q = tree[p].left;
+        if (tree[q].right != nil) {
             do {
-                q = rightChildren_[q];
-            } while (rightChildren_[q] != settings_.frameSize);
-            rightChildren_[parents_[q]] = leftChildren_[q];
-            parents_[leftChildren_[q]] = parents_[q];
-            leftChildren_[q] = leftChildren_[p];
-            parents_[leftChildren_[p]] = q;
-        }
-        rightChildren_[q] = rightChildren_[p];
-        parents_[rightChildren_[p]] = q;
-    }
-    parents_[q] = parents_[p];
-    if (rightChildren_[parents_[p]] == p) {
-        rightChildren_[parents_[p]] = q;
+                q = tree[q].right;
+            } while (tree[q].right != nil);
+            tree[tree[q].parent].right = tree[q].left;
+            tree[tree[q].left].parent = tree[q].parent;
+            tree[q].left = tree[p].left;
+            tree[tree[p].left].parent = q;
+        }
+        tree[q].right = tree[p].right;
+        tree[tree[p].right].parent = q;
+    }
+    tree[q].parent = tree[p].parent;
+    if (tree[tree[p].parent].right == p) {
+        tree[tree[p].parent].right = q;
     } else {
-        leftChildren_[parents_[p]] = q;
+        tree[tree[p].parent].left = q;
     }
-    parents_[p] = settings_.frameSize;
+    tree[p].parent = nil;
+    return true;
 }
 
-void LzssCompression::Decompress() {
+template <typename Shape>
+int32_t LzssCompression::InsertNode(Shape shape, int32_t r) {
+    if (!narrowTree_.empty()) {
+        return InsertTreeNode(shape, narrowTree_.data(), r);
+    }
+    return InsertTreeNode(shape, wideTree_.data(), r);
+}
+
+template <typename Shape>
+bool LzssCompression::DeleteNode(Shape shape, int32_t p) {
+    if (!narrowTree_.empty()) {
+        return DeleteTreeNode(shape, narrowTree_.data(), p);
+    }
+    return DeleteTreeNode(shape, wideTree_.data(), p);
+}
+
+template <typename Shape>
+int32_t LzssCompression::InsertString(Shape shape, int32_t r) {
+    if (settings_.matchFinder == LzssMatchFinder::HashChain) {
+        return InsertHashChain(shape, r);
+    }
+    return InsertNode(shape, r);
+}
+
+template <typename Shape>
+bool LzssCompression::DeleteString(Shape shape, int32_t p) {
+    // Hash chains never unlink: entries that slid out of the window are
+    // recognised by their distance when the chain is walked.
+    if (settings_.matchFinder == LzssMatchFinder::BinaryTree) {
+        return DeleteNode(shape, p);
+    }
+    return false;
+}
+
+template <typename Shape>
+int32_t LzssCompression::HashAt(Shape shape, int32_t r) const {
+    uint32_t h = 0;
+    for (int32_t i = 0; i <= shape.minMatchLength; i++) {
+        h = (h << 5) ^ (h >> 27) ^ buffer_[r + i];
+    }
+    h *= 0x9E3779B1u;
+    return static_cast<int32_t>(h >> 16) & (shape.frameSize * 2 - 1);
+}
+
+// Finds the longest match for buffer_[r..] among the most recent chainDepth
+// positions sharing its hash, then links r in as the new chain head. A chain
+// is cut as soon as it leaves the window or stops getting older, which is
+// how stale links to overwritten positions are skipped.
+template <typename Shape>
+int32_t LzssCompression::InsertHashChain(Shape shape, int32_t r) {
+    const int32_t mask = shape.frameSize - 1;
+    const int32_t maxDistance = shape.frameSize - shape.maxMatchLength;
+    int32_t h = HashAt(shape, r);
+    const uint32_t head = hashHeads_[h];
+    const int32_t first = (head >> kStampShift) == hashStamp_ ? static_cast<int32_t>(head & kHeadMask) : shape.frameSize;
+    int32_t p = first;
+    int32_t lastDistance = 0;
+    int32_t steps = 0;
+    matchLength_ = 0;
+
+    for (int32_t depth = settings_.chainDepth; depth > 0 && p != shape.frameSize; depth--) {
+        int32_t distance = (r - p) & mask;
+        if (distance <= lastDistance || distance > maxDistance) {
+            break;
+        }
+        lastDistance = distance;
+        steps++;
+
+        int32_t i = MatchLength(&buffer_[r], &buffer_[p], shape.maxMatchLength);
+        if (i > matchLength_) {
+            matchPosition_ = p;
+            if ((matchLength_ = i) >= shape.maxMatchLength) {
+                break;
+            }
+        }
+        p = hashChain_[p];
+    }
+    hashChain_[r] = first;
+    hashHeads_[h] = (hashStamp_ << kStampShift) | static_cast<uint32_t>(r);
+    return steps;
+}
+
+template <typename Shape, typename Reader, typename Writer>
+void LzssCompression::DecompressImpl(Shape shape, Reader& reader, Writer& writer) {
     if (isCompress_) {
         throw std::runtime_error("Not in decompression mode");
     }
+    PhaseTimer timer(settings_.stats, &LzssStats::decompressTime);
 
+    const size_t mask = shape.frameSize - 1;
+    const size_t groupOutput = 8 * LongestMatch(shape);
     uint32_t flag = 0;
     int32_t byteRead, distance, length;
     
     while (true) {
+        // Whole flag groups decode straight into the ring without bounds
+        // checks while the reader holds the largest group and the ring has
+        // room for its largest output before it wraps. The per-token loop
+        // below handles the rest.
+        while (((flag >> 1) & 256) == 0 && reader.Available() >= GroupInputSize(shape) &&
+               settings_.frameInitPos + groupOutput <= static_cast<size_t>(shape.frameSize)) {
+            const uint8_t* const in = reader.Data();
+            uint8_t* const out = &buffer_[settings_.frameInitPos];
+            const size_t start = settings_.frameInitPos;
+            uint32_t bits = in[0];
+            size_t ip = 1;
+            size_t op = 0;
+            if (bits == 0xff) {
+                std::memcpy(out, in + 1, 8);
+                ip += 8;
+                op += 8;
+            } else {
+                for (int32_t k = 0; k < 8; k++, bits >>= 1) {
+                    if ((bits & 1) != 0) {
+                        out[op++] = in[ip++];
+                        continue;
+                    }
+                    size_t position, size;
+                    ParseMatch(shape, in + ip, position, size);
+                    ip += shape.wideTokens ? 3 : 2;
+                    position &= mask;
+                    if (position < start + op) {
+                        CopyMatch(out + op, &buffer_[position], size);
+                    } else if (position + size <= static_cast<size_t>(shape.frameSize)) {
+                        // The source lies ahead in the ring and is read
+                        // before the destination reaches it
+                        std::memmove(out + op, &buffer_[position], size);
+                    } else {
+                        for (size_t n = 0; n < size; n++) {
+                            out[op + n] = buffer_[(position + n) & mask];
+                        }
+                    }
+                    op += size;
+                }
+            }
+            reader.Skip(ip);
+            writer.Write(out, op);
+            settings_.frameInitPos = static_cast<int32_t>((start + op) & mask);
+            windowAdvance_ += op;
+            flag = 0;
+        }
+
         if (((flag >>= 1) & 256) == 0) {
-            byteRead = input_.get();
+            byteRead = reader.Get();
             if (byteRead == std::char_traits<char>::eof()) break;
             flag = static_cast<uint8_t>(byteRead) | 0xff00;
         }
 
         if ((flag & 1) != 0) {
-            byteRead = input_.get();
+            byteRead = reader.Get();
             if (byteRead == std::char_traits<char>::eof()) break;
-            output_.put(static_cast<char>(byteRead));
+            writer.Put(static_cast<uint8_t>(byteRead));
             buffer_[settings_.frameInitPos++] = static_cast<uint8_t>(byteRead);
-            settings_.frameInitPos &= settings_.frameSize - 1;
+            settings_.frameInitPos &= shape.frameSize - 1;
+            windowAdvance_++;
         } else {
-            distance = input_.get();
+            distance = reader.Get();
             if (distance == std::char_traits<char>::eof()) break;
-            length = input_.get();
+            length = reader.Get();
             if (length == std::char_traits<char>::eof()) break;
 
-            distance |= (length & 0xf0) << 4;
-            length = (length & 0x0f) + settings_.minMatchLength;
+            if (shape.wideTokens) {
+                distance |= length << 8;
+                length = reader.Get();
+                if (length == std::char_traits<char>::eof()) break;
+                length += shape.minMatchLength;
+            } else {
+                distance |= (length & 0xf0) << 4;
+                length = (length & 0x0f) + shape.minMatchLength;
+            }
+            windowAdvance_ += length + 1;
+
+            int32_t r = settings_.frameInitPos;
+            int32_t back = ((r - distance - 1) & (shape.frameSize - 1)) + 1;
+            if (back > length && r + length < shape.frameSize && distance + length < shape.frameSize) {
+                // Neither side wraps and the source is not overwritten while
+                // it is read, so the match is one block move.
+                std::memmove(&buffer_[r], &buffer_[distance], length + 1);
+                writer.Write(&buffer_[r], length + 1);
+                settings_.frameInitPos = (r + length + 1) & (shape.frameSize - 1);
+                continue;
+            }
 
             for (int32_t k = 0; k <= length; k++) {
-                byteRead = buffer_[(distance + k) & (settings_.frameSize - 1)];
-                output_.put(static_cast<char>(byteRead));
+                byteRead = buffer_[(distance + k) & (shape.frameSize - 1)];
+                writer.Put(static_cast<uint8_t>(byteRead));
                 buffer_[settings_.frameInitPos++] = static_cast<uint8_t>(byteRead);
-                settings_.frameInitPos &= settings_.frameSize - 1;
+                settings_.frameInitPos &= shape.frameSize - 1;
             }
         }
     }
+    writer.Flush();
+    if (settings_.stats != nullptr) {
+        settings_.stats->bytesIn += reader.Consumed();
+        settings_.stats->bytesOut += writer.Written();
+    }
 }
 
-void LzssCompression::Compress() {
+template <typename Shape, typename Reader, typename Writer>
+void LzssCompression::CompressImpl(Shape shape, Reader& reader, Writer& writer, EncodeMode mode) {
     if (!isCompress_) {
         throw std::runtime_error("Not in compression mode");
     }
+    LzssStats* const stats = settings_.stats;
+    PhaseTimer timer(stats, &LzssStats::compressTime);
+    if (stats != nullptr && stats->matchLengths.size() <= static_cast<size_t>(shape.maxMatchLength)) {
+        stats->matchLengths.resize(shape.maxMatchLength + 1);
+    }
 
-    int32_t r = settings_.frameInitPos;
-    int32_t s = 0;
-    int32_t len = 0;
+    // The state lives in locals while the loop runs; byte stores into the
+    // window could otherwise alias it and force reloads
+    int32_t r = encoder_.r;
+    int32_t s = encoder_.s;
+    int32_t len = encoder_.len;
+    int32_t pending = encoder_.pending;
+    int32_t fresh = encoder_.fresh;
+    size_t parsed = encoder_.parsed;
     int32_t i, c, lastMatchLength;
-    std::vector<uint8_t> codeBuf(17);
-    size_t codeBufPtr = 1;
-    uint8_t mask = 1;
-
-    InitTree();
-    codeBuf[0] = 0;
+    uint8_t* codeBuf = encoder_.codeBuf;
+    size_t codeBufPtr = encoder_.codeBufPtr;
+    size_t codeBufSent = encoder_.codeBufSent;
+    uint8_t mask = encoder_.mask;
+    bool filling = encoder_.filling;
+    // Match finder work, kept in locals and added to the stats at the end
+    uint64_t searches = 0;
+    uint64_t searchSteps = 0;
+    uint64_t deletions = 0;
+    auto insert = [&](int32_t pos) {
+        searchSteps += InsertString(shape, pos);
+        searches++;
+    };
+    auto remove = [&](int32_t pos) {
+        if (fresh > 0) {
+            fresh--;
+            return;
+        }
+        deletions += DeleteString(shape, pos);
+    };
 
-    // Read initial bytes
-    for (len = 0; len < settings_.maxMatchLength; len++) {
-        c = input_.get();
-        if (c == std::char_traits<char>::eof()) break;
-        buffer_[r + len] = static_cast<uint8_t>(c);
-    }
-    
-    if (len == 0) {
-        return;
-    }
+    if (filling) {
+        // Load the lookahead, either at the start of the stream or after a
+        // Flush() encoded all of it
+        for (; len < shape.maxMatchLength; len++) {
+            c = reader.Get();
+            if (c == std::char_traits<char>::eof()) break;
+            int32_t pos = (r + len) & (shape.frameSize - 1);
+            buffer_[pos] = static_cast<uint8_t>(c);
+            if (pos < shape.maxMatchLength - 1) {
+                buffer_[pos + shape.frameSize] = static_cast<uint8_t>(c);
+            }
+        }
 
-    for (i = 1; i <= settings_.maxMatchLength; i++) {
-        InsertNode(r - i);
+        if (len == shape.maxMatchLength || (len > 0 && mode != EncodeMode::Buffer)) {
+            if (!encoder_.started) {
+                for (i = 1; i <= shape.maxMatchLength; i++) {
+                    insert((r - i) & (shape.frameSize - 1));
+                }
+                encoder_.started = true;
+            }
+            insert(r);
+            filling = false;
+        }
     }
-    InsertNode(r);
 
-    do {
-        if (matchLength_ > len) {
-            matchLength_ = len;
+    // Adds one token to the current group and writes the group out once all
+    // eight flag bits are used; after a Flush() only its unsent tail goes out
+    auto endGroup = [&]() {
+        writer.Write(codeBuf + codeBufSent, codeBufPtr - codeBufSent);
+        codeBuf[0] = 0;
+        codeBufPtr = 1;
+        codeBufSent = 0;
+        mask = 1;
+    };
+    auto putLiteral = [&](uint8_t value) {
+        if (stats != nullptr) {
+            stats->literals++;
         }
-        
-        if (matchLength_ <= settings_.minMatchLength) {
-            matchLength_ = 1;
-            codeBuf[0] |= mask;
-            codeBuf[codeBufPtr++] = buffer_[r];
+        codeBuf[0] |= mask;
+        codeBuf[codeBufPtr++] = value;
+        if ((mask <<= 1) == 0) {
+            endGroup();
+        }
+    };
+    auto putMatch = [&](int32_t position, int32_t length) {
+        if (stats != nullptr) {
+            stats->matches++;
+            stats->matchLengths[length]++;
+        }
+        codeBuf[codeBufPtr++] = static_cast<uint8_t>(position);
+        if (shape.wideTokens) {
+            codeBuf[codeBufPtr++] = static_cast<uint8_t>(position >> 8);
+            codeBuf[codeBufPtr++] = static_cast<uint8_t>(length - (shape.minMatchLength + 1));
         } else {
-            codeBuf[codeBufPtr++] = static_cast<uint8_t>(matchPosition_);
             codeBuf[codeBufPtr++] = static_cast<uint8_t>(
-                ((matchPosition_ >> 4) & 0xf0) | 
-                (matchLength_ - (settings_.minMatchLength + 1))
+                ((position >> 4) & 0xf0) | 
+                (length - (shape.minMatchLength + 1))
             );
         }
-
         if ((mask <<= 1) == 0) {
-            for (i = 0; i < codeBufPtr; i++) {
-                output_.put(static_cast<char>(codeBuf[i]));
+            endGroup();
+        }
+    };
+    // Encodes the positions collected in parse_ with the fewest bits: nine
+    // per literal, the token and a flag bit per match. Every prefix of a
+    // match is a match at the same position, so the longest match found at
+    // a position offers every shorter length too. Unless the stream ends
+    // here, the tokens stop short of the last maxMatchLength positions,
+    // whose matches are cut by the end of the block; those stay in parse_
+    // to be chosen again with the next block.
+    auto encodeParsed = [&](bool last) {
+        ParseStep* const steps = parse_.data();
+        const uint32_t matchBits = shape.wideTokens ? 25 : 17;
+        steps[parsed].cost = 0;
+        for (size_t j = parsed; j-- > 0;) {
+            ParseStep& step = steps[j];
+            step.cost = steps[j + 1].cost + 9;
+            step.choice = 1;
+            // Ties go to the longest match, which makes fewer tokens
+            const size_t longest = std::min<size_t>(step.length, parsed - j);
+            for (size_t n = longest; n > static_cast<size_t>(shape.minMatchLength); n--) {
+                if (steps[j + n].cost + matchBits < step.cost) {
+                    step.cost = steps[j + n].cost + matchBits;
+                    step.choice = static_cast<uint16_t>(n);
+                }
             }
-            codeBuf[0] = 0;
-            codeBufPtr = 1;
-            mask = 1;
         }
-
-        lastMatchLength = matchLength_;
-        for (i = 0; i < lastMatchLength; i++) {
-            c = input_.get();
+        const size_t end = last ? parsed : parsed - shape.maxMatchLength;
+        size_t j = 0;
+        while (j < end) {
+            const ParseStep& step = steps[j];
+            if (step.choice == 1 || codeBufSent != 0) {
+                putLiteral(step.literal);
+                j++;
+            } else {
+                putMatch(step.position, step.choice);
+                j += step.choice;
+            }
+        }
+        std::copy(steps + j, steps + parsed, steps);
+        parsed -= j;
+    };
+    // Slides the window forward by count positions, refilling the lookahead
+    // and adding each new position to the match finder. When the input runs
+    // dry the lookahead shrinks instead, unless more input is expected: then
+    // the remaining steps wait in pending for the next call.
+    auto advance = [&](int32_t count) {
+        for (i = 0; i < count; i++) {
+            c = reader.Get();
             if (c == std::char_traits<char>::eof()) break;
-            DeleteNode(s);
+            remove(s);
             buffer_[s] = static_cast<uint8_t>(c);
-            if (s < settings_.maxMatchLength - 1) {
-                buffer_[s + settings_.frameSize] = static_cast<uint8_t>(c);
+            if (s < shape.maxMatchLength - 1) {
+                buffer_[s + shape.frameSize] = static_cast<uint8_t>(c);
             }
-            s = (s + 1) & (settings_.frameSize - 1);
-            r = (r + 1) & (settings_.frameSize - 1);
-            InsertNode(r);
+            s = (s + 1) & (shape.frameSize - 1);
+            r = (r + 1) & (shape.frameSize - 1);
+            insert(r);
         }
+        if (mode == EncodeMode::Buffer) {
+            windowAdvance_ += i;
+            pending = count - i;
+            return;
+        }
+        windowAdvance_ += count;
         
-        while (i++ < lastMatchLength) {
-            DeleteNode(s);
-            s = (s + 1) & (settings_.frameSize - 1);
-            r = (r + 1) & (settings_.frameSize - 1);
+        while (i++ < count) {
+            remove(s);
+            s = (s + 1) & (shape.frameSize - 1);
+            r = (r + 1) & (shape.frameSize - 1);
             if (--len != 0) {
-                InsertNode(r);
+                insert(r);
+            }
+        }
+        pending = 0;
+    };
+
+    while (!filling) {
+        if (pending > 0) {
+            advance(pending);
+            if (pending > 0) {
+                break;
+            }
+            filling = len == 0;
+            continue;
+        }
+        // Every decision is taken with fresh input at hand, so the lazy
+        // look-ahead step below never waits
+        if (mode == EncodeMode::Buffer && reader.Available() == 0) {
+            break;
+        }
+
+        if (matchLength_ > len) {
+            matchLength_ = len;
+        }
+
+        if (settings_.optimalParsing) {
+            // The match finder state only depends on the input, so every
+            // position is visited and tokens are chosen once a block is in
+            ParseStep& step = parse_[parsed++];
+            step.position = static_cast<uint16_t>(matchPosition_);
+            step.length = static_cast<uint16_t>(matchLength_);
+            step.literal = buffer_[r];
+            if (parsed == kParseBlockSize) {
+                encodeParsed(false);
+            }
+            advance(1);
+            filling = len == 0;
+            continue;
+        }
+
+        // After a Flush() the flag byte of this group is already out with
+        // its remaining bits set, so the group has to be completed with
+        // literals
+        const bool literalsOnly = codeBufSent != 0;
+
+        if (settings_.lazyMatching && !literalsOnly && matchLength_ > shape.minMatchLength &&
+            matchLength_ < shape.maxMatchLength) {
+            // Look one position ahead; if the match there is longer, r goes
+            // out as a literal and the next iteration takes the longer match
+            int32_t position = matchPosition_;
+            int32_t length = matchLength_;
+            uint8_t literal = buffer_[r];
+            advance(1);
+            if (matchLength_ > len) {
+                matchLength_ = len;
+            }
+            if (matchLength_ > length) {
+                putLiteral(literal);
+            } else {
+                putMatch(position, length);
+                advance(length - 1);
+            }
+        } else {
+            if (matchLength_ <= shape.minMatchLength || literalsOnly) {
+                matchLength_ = 1;
+                putLiteral(buffer_[r]);
+            } else {
+                putMatch(matchPosition_, matchLength_);
+            }
+
+            lastMatchLength = matchLength_;
+            advance(lastMatchLength);
+        }
+        filling = len == 0;
+    }
+
+    if (filling && mode != EncodeMode::Buffer && parsed != 0) {
+        encodeParsed(true);
+    }
+    if (filling && mode != EncodeMode::Buffer && mask != 1) {
+        if (mode == EncodeMode::Flush) {
+            codeBuf[0] |= static_cast<uint8_t>(~(mask - 1));
+            writer.Write(codeBuf + codeBufSent, codeBufPtr - codeBufSent);
+            codeBufSent = codeBufPtr;
+        } else {
+            endGroup();
+        }
+    }
+    writer.Flush();
+    if (stats != nullptr) {
+        stats->bytesIn += reader.Consumed();
+        stats->bytesOut += writer.Written();
+        stats->searches += searches;
+        stats->searchSteps += searchSteps;
+        stats->nodeDeletions += deletions;
+    }
+
+    encoder_.r = r;
+    encoder_.s = s;
+    encoder_.len = len;
+    encoder_.pending = pending;
+    encoder_.fresh = fresh;
+    encoder_.parsed = parsed;
+    encoder_.codeBufPtr = codeBufPtr;
+    encoder_.codeBufSent = codeBufSent;
+    encoder_.mask = mask;
+    encoder_.filling = filling;
+    encoder_.active = mode != EncodeMode::Finish;
+}
+
+// Decodes tokens from input[inPos] into output[outPos], copying back-references
+// directly from the bytes already decoded in this call and only falling back
+// to the ring buffer for data that predates it. Returns true once the input is
+// exhausted. With stopEarly set it returns false as soon as a token might not
+// fit into the remaining capacity, leaving inPos/flag at a token boundary so a
+// caller can grow the output and continue; otherwise the last match is
+// truncated at outputCapacity.
+template <typename Shape>
+bool LzssCompression::DecodeInto(Shape shape, const uint8_t* input, size_t inputSize, size_t& inPos, uint32_t& flag,
+                                 uint8_t* output, size_t& outPos, size_t outputCapacity, bool stopEarly) {
+    const size_t mask = shape.frameSize - 1;
+    const size_t origin = settings_.frameInitPos;
+    const size_t room = stopEarly ? LongestMatch(shape) : 1;
+    // Worst-case output of a flag group, plus the overrun of WideCopy
+    const size_t groupOutput = 8 * LongestMatch(shape) + 16;
+    size_t ip = inPos;
+    size_t op = outPos;
+    bool exhausted = false;
+
+    while (outputCapacity - op >= room) {
+        // With a whole group's worth of input and output left, the group is
+        // decoded without any bounds checks
+        if (((flag >> 1) & 256) == 0 && inputSize - ip >= GroupInputSize(shape) &&
+            outputCapacity - op >= groupOutput) {
+            uint32_t bits = input[ip++];
+            if (bits == 0xff) {
+                std::memcpy(output + op, input + ip, 8);
+                ip += 8;
+                op += 8;
+                continue;
+            }
+            for (int32_t k = 0; k < 8; k++, bits >>= 1) {
+                if ((bits & 1) != 0) {
+                    output[op++] = input[ip++];
+                    continue;
+                }
+                size_t distance, length;
+                ParseMatch(shape, input + ip, distance, length);
+                ip += shape.wideTokens ? 3 : 2;
+                size_t back = ((origin + op - distance - 1) & mask) + 1;
+                if (back <= op) {
+                    const uint8_t* from = output + op - back;
+                    if (back >= 16) {
+                        WideCopy<16>(output + op, from, length);
+                    } else if (back >= 8) {
+                        WideCopy<8>(output + op, from, length);
+                    } else {
+                        CopyMatch(output + op, from, length);
+                    }
+                } else {
+                    for (size_t n = 0; n < length; n++) {
+                        size_t from = op + n - back;
+                        output[op + n] = (op + n >= back) ? output[from] : buffer_[(origin + from) & mask];
+                    }
+                }
+                op += length;
+            }
+            continue;
+        }
+
+        if (((flag >>= 1) & 256) == 0) {
+            if (ip == inputSize) {
+                exhausted = true;
+                break;
+            }
+            flag = input[ip++] | 0xff00;
+        }
+
+        if ((flag & 1) != 0) {
+            if (ip == inputSize) {
+                exhausted = true;
+                break;
+            }
+            output[op++] = input[ip++];
+        } else {
+            const size_t matchSize = shape.wideTokens ? 3 : 2;
+            if (inputSize - ip < matchSize) {
+                exhausted = true;
+                break;
+            }
+            size_t distance, length;
+            ParseMatch(shape, input + ip, distance, length);
+            ip += matchSize;
+
+            size_t back = ((origin + op - distance - 1) & mask) + 1;
+            length = std::min(length, outputCapacity - op);
+            if (back <= op) {
+                const uint8_t* from = output + op - back;
+                size_t slack = outputCapacity - op;
+                if (back >= 16 && slack >= ((length + 15) & ~size_t(15))) {
+                    WideCopy<16>(output + op, from, length);
+                } else if (back >= 8 && slack >= ((length + 7) & ~size_t(7))) {
+                    WideCopy<8>(output + op, from, length);
+                } else {
+                    for (size_t k = 0; k < length; k++) {
+                        output[op + k] = from[k];
+                    }
+                }
+            } else {
+                for (size_t k = 0; k < length; k++) {
+                    size_t from = op + k - back;
+                    output[op + k] = (op + k >= back) ? output[from] : buffer_[(origin + from) & mask];
+                }
+            }
+            op += length;
+        }
+    }
+
+    inPos = ip;
+    outPos = op;
+    return exhausted;
+}
+
+// Runs the window decoder as a state machine over decoder_, so it can stop
+// after any output byte and after any input byte. Every byte it decodes goes
+// through the ring and is copied out of it, so once a token split across
+// calls is complete, the whole tokens that follow are handed to DecodeInto()
+// instead, up to the last LongestMatch() bytes of room.
+template <typename Shape>
+size_t LzssCompression::DecodeStep(Shape shape, const uint8_t* input, size_t inputSize, size_t& inputUsed,
+                                   uint8_t* output, size_t outputCapacity) {
+    const int32_t mask = shape.frameSize - 1;
+    const int32_t matchSize = shape.wideTokens ? 3 : 2;
+    DecoderState state = decoder_;
+    int32_t r = settings_.frameInitPos;
+    size_t ip = 0;
+    size_t op = 0;
+    // Whether DecodeInto() had its turn, and the output it counted into
+    // windowAdvance_ through SyncWindow()
+    bool direct = false;
+    size_t synced = 0;
+
+    while (true) {
+        if (state.matchLeft > 0) {
+            int32_t n = static_cast<int32_t>(std::min<size_t>(state.matchLeft, outputCapacity - op));
+            if (n == 0) {
+                break;
+            }
+            int32_t back = ((r - state.matchFrom - 1) & mask) + 1;
+            if (back >= n && r + n <= shape.frameSize && state.matchFrom + n <= shape.frameSize) {
+                std::memmove(&buffer_[r], &buffer_[state.matchFrom], n);
+            } else {
+                for (int32_t k = 0; k < n; k++) {
+                    buffer_[(r + k) & mask] = buffer_[(state.matchFrom + k) & mask];
+                }
+            }
+            for (int32_t k = 0; k < n; k++) {
+                output[op + k] = buffer_[(r + k) & mask];
+            }
+            op += n;
+            r = (r + n) & mask;
+            state.matchFrom = (state.matchFrom + n) & mask;
+            state.matchLeft -= n;
+            continue;
+        }
+        if (op == outputCapacity) {
+            break;
+        }
+        if (!direct && state.tokenSize == 0) {
+            // DecodeInto() sees output[0] at ring position r - op. It keeps
+            // the flags unshifted between tokens, as here, but has already
+            // shifted them for a token it runs out of input on.
+            settings_.frameInitPos = (r - static_cast<int32_t>(op)) & mask;
+            uint32_t flag = state.flag;
+            bool exhausted = DecodeInto(shape, input, inputSize, ip, flag, output, op, outputCapacity, true);
+            state.flag = exhausted ? flag << 1 : flag;
+            SyncWindow(output, op);
+            direct = true;
+            synced = op;
+            r = settings_.frameInitPos;
+            continue;
+        }
+
+        if ((state.flag & 512) == 0) {
+            if (ip == inputSize) {
+                break;
+            }
+            state.flag = (input[ip++] | 0xff00) << 1;
+        }
+        const bool literal = ((state.flag >> 1) & 1) != 0;
+        const int32_t need = literal ? 1 : matchSize;
+        const uint8_t* token;
+        if (state.tokenSize > 0 || inputSize - ip < static_cast<size_t>(need)) {
+            while (state.tokenSize < need && ip < inputSize) {
+                state.token[state.tokenSize++] = input[ip++];
+            }
+            if (state.tokenSize < need) {
+                break;
             }
+            token = state.token;
+            state.tokenSize = 0;
+        } else {
+            token = input + ip;
+            ip += need;
         }
-    } while (len > 0);
+        state.flag >>= 1;
 
-    if (codeBufPtr > 1) {
-        for (i = 0; i < codeBufPtr; i++) {
-            output_.put(static_cast<char>(codeBuf[i]));
+        if (literal) {
+            buffer_[r] = token[0];
+            output[op++] = token[0];
+            r = (r + 1) & mask;
+        } else if (shape.wideTokens) {
+            state.matchFrom = (token[0] | (token[1] << 8)) & mask;
+            state.matchLeft = token[2] + shape.minMatchLength + 1;
+        } else {
+            state.matchFrom = (token[0] | ((token[1] & 0xf0) << 4)) & mask;
+            state.matchLeft = (token[1] & 0x0f) + shape.minMatchLength + 1;
         }
     }
+
+    decoder_ = state;
+    settings_.frameInitPos = r;
+    windowAdvance_ += op - synced;
+    inputUsed = ip;
+    return op;
+}
+
+// Moves the ring buffer forward past outputSize bytes decoded by DecodeInto so
+// later calls see the same window as the stream decoder would.
+void LzssCompression::SyncWindow(const uint8_t* output, size_t outputSize) {
+    const size_t mask = settings_.frameSize - 1;
+    const size_t origin = settings_.frameInitPos;
+    size_t i = outputSize - std::min<size_t>(outputSize, settings_.frameSize);
+    for (; i < outputSize; i++) {
+        buffer_[(origin + i) & mask] = output[i];
+    }
+    settings_.frameInitPos = static_cast<int32_t>((origin + outputSize) & mask);
+    windowAdvance_ += outputSize;
+}
+
+void LzssCompression::Compress() {
+    if (input_ == nullptr || output_ == nullptr) {
+        throw std::runtime_error("No streams attached");
+    }
+    StreamReader reader(*input_, settings_.ioBufferSize, settings_.memoryResource);
+    StreamWriter writer(*output_, settings_.ioBufferSize, settings_.memoryResource);
+    BeginStream();
+    DispatchShape(settings_, [&](auto shape) { CompressImpl(shape, reader, writer, EncodeMode::Finish); });
+}
+
+void LzssCompression::Decompress() {
+    if (input_ == nullptr || output_ == nullptr) {
+        throw std::runtime_error("No streams attached");
+    }
+    StreamReader reader(*input_, settings_.ioBufferSize, settings_.memoryResource);
+    StreamWriter writer(*output_, settings_.ioBufferSize, settings_.memoryResource);
+    DispatchShape(settings_, [&](auto shape) { DecompressImpl(shape, reader, writer); });
+}
+
+void LzssCompression::Compress(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output) {
+    MemoryReader reader(input, inputSize);
+    VectorWriter writer(output);
+    output.reserve(output.size() + CompressBound(inputSize));
+    BeginStream();
+    DispatchShape(settings_, [&](auto shape) { CompressImpl(shape, reader, writer, EncodeMode::Finish); });
+}
+
+size_t LzssCompression::Compress(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity) {
+    MemoryReader reader(input, inputSize);
+    BufferWriter writer(output, outputCapacity);
+    BeginStream();
+    DispatchShape(settings_, [&](auto shape) { CompressImpl(shape, reader, writer, EncodeMode::Finish); });
+    return writer.Size();
+}
+
+void LzssCompression::Feed(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output) {
+    if (!encoder_.active) {
+        BeginStream();
+    }
+    MemoryReader reader(input, inputSize);
+    VectorWriter writer(output);
+    DispatchShape(settings_, [&](auto shape) { CompressImpl(shape, reader, writer, EncodeMode::Buffer); });
+}
+
+void LzssCompression::Flush(std::vector<uint8_t>& output) {
+    if (!encoder_.active) {
+        return;
+    }
+    MemoryReader reader(nullptr, 0);
+    VectorWriter writer(output);
+    DispatchShape(settings_, [&](auto shape) { CompressImpl(shape, reader, writer, EncodeMode::Flush); });
+}
+
+void LzssCompression::Finish(std::vector<uint8_t>& output) {
+    if (!encoder_.active) {
+        return;
+    }
+    MemoryReader reader(nullptr, 0);
+    VectorWriter writer(output);
+    DispatchShape(settings_, [&](auto shape) { CompressImpl(shape, reader, writer, EncodeMode::Finish); });
+}
+
+void LzssCompression::Decompress(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output) {
+    if (isCompress_) {
+        throw std::runtime_error("Not in decompression mode");
+    }
+
+    PhaseTimer timer(settings_.stats, &LzssStats::decompressTime);
+    const size_t start = output.size();
+    size_t inPos = 0;
+    size_t outPos = 0;
+    uint32_t flag = 0;
+    output.resize(start + inputSize * 2 + settings_.maxMatchLength);
+    DispatchShape(settings_, [&](auto shape) {
+        while (!DecodeInto(shape, input, inputSize, inPos, flag, output.data() + start, outPos,
+                           output.size() - start, true)) {
+            output.resize(start + (output.size() - start) * 2);
+        }
+    });
+    output.resize(start + outPos);
+    SyncWindow(output.data() + start, outPos);
+    CountDecoded(inPos, outPos);
+}
+
+size_t LzssCompression::Decompress(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity) {
+    if (isCompress_) {
+        throw std::runtime_error("Not in decompression mode");
+    }
+
+    PhaseTimer timer(settings_.stats, &LzssStats::decompressTime);
+    size_t inPos = 0;
+    size_t outPos = 0;
+    uint32_t flag = 0;
+    DispatchShape(settings_, [&](auto shape) {
+        DecodeInto(shape, input, inputSize, inPos, flag, output, outPos, outputCapacity, false);
+    });
+    SyncWindow(output, outPos);
+    CountDecoded(inPos, outPos);
+    return outPos;
+}
+
+LzssTokenFormat GetTokenFormat(const LzssSettings& settings) {
+    const int32_t lengthRange = settings.maxMatchLength - settings.minMatchLength;
+    if (settings.frameSize <= 0x1000 && lengthRange <= 16) {
+        return LzssTokenFormat::Classic;
+    }
+    if (settings.frameSize <= 0x10000 && lengthRange <= 256 && settings.minMatchLength >= 2) {
+        return LzssTokenFormat::Wide;
+    }
+    throw std::invalid_argument("Window shape does not fit any token format");
+}
+
+size_t LzssCompression::DecompressStep(const uint8_t* input, size_t inputSize, size_t& inputUsed,
+                                       uint8_t* output, size_t outputCapacity) {
+    if (isCompress_) {
+        throw std::runtime_error("Not in decompression mode");
+    }
+
+    PhaseTimer timer(settings_.stats, &LzssStats::decompressTime);
+    size_t written = 0;
+    DispatchShape(settings_, [&](auto shape) {
+        written = DecodeStep(shape, input, inputSize, inputUsed, output, outputCapacity);
+    });
+    CountDecoded(inputUsed, written);
+    return written;
+}
+
+void LzssCompression::CountDecoded(size_t inputSize, size_t outputSize) {
+    if (settings_.stats != nullptr) {
+        settings_.stats->bytesIn += inputSize;
+        settings_.stats->bytesOut += outputSize;
+    }
+}
+
+LzssStats& LzssStats::operator+=(const LzssStats& other) {
+    bytesIn += other.bytesIn;
+    bytesOut += other.bytesOut;
+    literals += other.literals;
+    matches += other.matches;
+    if (matchLengths.size() < other.matchLengths.size()) {
+        matchLengths.resize(other.matchLengths.size());
+    }
+    for (size_t i = 0; i < other.matchLengths.size(); i++) {
+        matchLengths[i] += other.matchLengths[i];
+    }
+    searches += other.searches;
+    searchSteps += other.searchSteps;
+    nodeDeletions += other.nodeDeletions;
+    initTime += other.initTime;
+    compressTime += other.compressTime;
+    decompressTime += other.decompressTime;
+    return *this;
+}
+
+size_t CompressBound(size_t inputSize) {
+    return inputSize + (inputSize + 7) / 8;
+}
+
+size_t DecompressBound(size_t inputSize, const LzssSettings& settings) {
+    size_t bound = 0;
+    DispatchShape(settings, [&](auto shape) {
+        const size_t matchSize = shape.wideTokens ? 3 : 2;
+        bound = inputSize / matchSize * LongestMatch(shape) + inputSize % matchSize;
+    });
+    return bound;
 }
 
-// Helper functions that use memory streams
 std::vector<uint8_t> CompressData(const std::vector<uint8_t>& input) {
-    std::stringstream inputStream;
-    std::stringstream outputStream;
-    inputStream.write(reinterpret_cast<const char*>(input.data()), input.size());
-    
-    LzssCompression lzss(inputStream, outputStream, true);
-    lzss.Compress();
-    
-    std::string result = outputStream.str();
-    return std::vector<uint8_t>(result.begin(), result.end());
+    std::vector<uint8_t> output;
+    CompressData(input.data(), input.size(), output);
+    return output;
 }
 
 std::vector<uint8_t> DecompressData(const std::vector<uint8_t>& input) {
-    std::stringstream inputStream;
-    std::stringstream outputStream;
-    inputStream.write(reinterpret_cast<const char*>(input.data()), input.size());
-    
-    LzssCompression lzss(inputStream, outputStream, false);
-    lzss.Decompress();
-    
-    std::string result = outputStream.str();
-    return std::vector<uint8_t>(result.begin(), result.end());
+    std::vector<uint8_t> output;
+    DecompressData(input.data(), input.size(), output);
+    return output;
+}
+
+void CompressData(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output,
+                  const LzssSettings& settings) {
+    output.clear();
+    LzssCompression lzss(true, settings);
+    lzss.Compress(input, inputSize, output);
+}
+
+size_t CompressData(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity,
+                    const LzssSettings& settings) {
+    LzssCompression lzss(true, settings);
+    return lzss.Compress(input, inputSize, output, outputCapacity);
+}
+
+void DecompressData(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output,
+                    const LzssSettings& settings) {
+    output.clear();
+    LzssCompression lzss(false, settings);
+    lzss.Decompress(input, inputSize, output);
+}
+
+size_t DecompressData(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity,
+                      const LzssSettings& settings) {
+    LzssCompression lzss(false, settings);
+    return lzss.Decompress(input, inputSize, output, outputCapacity);
 }
 
 } // namespace Compression
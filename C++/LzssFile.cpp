@@ -0,0 +1,318 @@
+#include "LzssFile.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LZSS_HAS_MMAP 1
+#else
+#include <fstream>
+#include <iterator>
+#include <random>
+#endif
+
+namespace Compression {
+
+namespace {
+
+void CheckDistinct(const std::string& inputPath, const std::string& outputPath) {
+    std::error_code error;
+    if (std::filesystem::equivalent(inputPath, outputPath, error)) {
+        throw std::invalid_argument("Output path names the input file " + inputPath);
+    }
+}
+
+#if LZSS_HAS_MMAP
+
+[[noreturn]] void ThrowErrno(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Read-only mapping of a whole file
+class InputMapping {
+public:
+    explicit InputMapping(const std::string& path)
+        : fd_(open(path.c_str(), O_RDONLY))
+        , data_(nullptr)
+        , size_(0)
+    {
+        if (fd_ < 0) {
+            ThrowErrno("open " + path);
+        }
+        struct stat st;
+        if (fstat(fd_, &st) != 0) {
+            int error = errno;
+            close(fd_);
+            throw std::system_error(error, std::generic_category(), "stat " + path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (data == MAP_FAILED) {
+                int error = errno;
+                close(fd_);
+                throw std::system_error(error, std::generic_category(), "mmap " + path);
+            }
+            data_ = static_cast<const uint8_t*>(data);
+            madvise(data, size_, MADV_SEQUENTIAL);
+        }
+    }
+
+    ~InputMapping() {
+        if (data_ != nullptr) {
+            munmap(const_cast<uint8_t*>(data_), size_);
+        }
+        close(fd_);
+    }
+
+    InputMapping(const InputMapping&) = delete;
+    InputMapping& operator=(const InputMapping&) = delete;
+
+    const uint8_t* Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+private:
+    int fd_;
+    const uint8_t* data_;
+    size_t size_;
+};
+
+// Output file that is either mapped at a fixed size and trimmed with
+// Finish(), or written through Write() and then finished. It is built under a
+// temporary name in the same directory and renamed over path by Finish();
+// until then, destruction removes it.
+class OutputFile {
+public:
+    explicit OutputFile(const std::string& path)
+        : path_(path)
+        , tempPath_(path + ".XXXXXX")
+        , fd_(mkstemp(&tempPath_[0]))
+        , data_(nullptr)
+        , size_(0)
+    {
+        if (fd_ < 0) {
+            ThrowErrno("open " + tempPath_);
+        }
+        // mkstemp creates the file 0600; give it the mode of the file it
+        // replaces, or the mode a plain create would have given it
+        struct stat st;
+        mode_t mode;
+        if (stat(path.c_str(), &st) == 0) {
+            mode = st.st_mode & 07777;
+        } else {
+            mode_t mask = umask(0);
+            umask(mask);
+            mode = 0666 & ~mask;
+        }
+        if (fchmod(fd_, mode) != 0) {
+            int error = errno;
+            Discard();
+            throw std::system_error(error, std::generic_category(), "chmod " + tempPath_);
+        }
+    }
+
+    ~OutputFile() {
+        if (fd_ >= 0) {
+            Discard();
+        }
+    }
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    uint8_t* Map(size_t size) {
+        if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+            ThrowErrno("ftruncate " + tempPath_);
+        }
+        if (size > 0) {
+            void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if (data == MAP_FAILED) {
+                ThrowErrno("mmap " + tempPath_);
+            }
+            data_ = static_cast<uint8_t*>(data);
+            size_ = size;
+        }
+        return data_;
+    }
+
+    // Trims the file to size and moves it to path
+    void Finish(size_t size) {
+        Unmap();
+        if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+            ThrowErrno("ftruncate " + tempPath_);
+        }
+        Finish();
+    }
+
+    // Moves the file written through Write() to path
+    void Finish() {
+        const bool closed = close(fd_) == 0;
+        fd_ = -1;
+        if (!closed || rename(tempPath_.c_str(), path_.c_str()) != 0) {
+            int error = errno;
+            unlink(tempPath_.c_str());
+            throw std::system_error(error, std::generic_category(), (closed ? "rename " : "close ") + tempPath_);
+        }
+    }
+
+    void Write(const uint8_t* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = write(fd_, data, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ThrowErrno("write " + tempPath_);
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+private:
+    void Unmap() {
+        if (data_ != nullptr) {
+            munmap(data_, size_);
+            data_ = nullptr;
+        }
+    }
+
+    void Discard() {
+        Unmap();
+        close(fd_);
+        fd_ = -1;
+        unlink(tempPath_.c_str());
+    }
+
+    std::string path_;
+    std::string tempPath_;
+    int fd_;
+    uint8_t* data_;
+    size_t size_;
+};
+
+#else
+
+// Without mmap the helpers fall back to whole-file stream I/O
+std::vector<uint8_t> ReadFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::system_error(std::make_error_code(std::errc::no_such_file_or_directory), "open " + path);
+    }
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// An unused name in the same directory as path, with a random suffix
+std::string MakeTempPath(const std::string& path) {
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    std::random_device device;
+    std::mt19937 rng(device());
+    for (int attempt = 0; attempt < 100; attempt++) {
+        std::string tempPath = path + ".";
+        for (int i = 0; i < 6; i++) {
+            tempPath += digits[rng() % (sizeof(digits) - 1)];
+        }
+        std::error_code error;
+        if (!std::filesystem::exists(tempPath, error) && !error) {
+            return tempPath;
+        }
+    }
+    throw std::system_error(std::make_error_code(std::errc::file_exists), "temporary name for " + path);
+}
+
+// Writes data under a temporary name and then moves it to path, keeping the
+// permissions of the file it replaces
+void WriteFile(const std::string& path, const std::vector<uint8_t>& data) {
+    const std::string tempPath = MakeTempPath(path);
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        file.close();
+        if (!file) {
+            std::remove(tempPath.c_str());
+            throw std::system_error(std::make_error_code(std::errc::io_error), "write " + tempPath);
+        }
+    }
+    std::error_code error;
+    const std::filesystem::file_status status = std::filesystem::status(path, error);
+    if (!error && std::filesystem::exists(status)) {
+        std::filesystem::permissions(tempPath, status.permissions(), error);
+        if (error) {
+            std::remove(tempPath.c_str());
+            throw std::system_error(error, "chmod " + tempPath);
+        }
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::remove(tempPath.c_str());
+        throw std::system_error(error, "rename " + path);
+    }
+}
+
+#endif
+
+} // namespace
+
+#if LZSS_HAS_MMAP
+
+void CompressFile(const std::string& inputPath, const std::string& outputPath,
+                  const LzssFrameSettings& settings) {
+    CheckDistinct(inputPath, outputPath);
+    InputMapping input(inputPath);
+    OutputFile output(outputPath);
+    const size_t bound = CompressFramedBound(input.Size(), settings);
+    uint8_t* target = output.Map(bound);
+    output.Finish(CompressFramed(input.Data(), input.Size(), target, bound, settings));
+}
+
+void DecompressFile(const std::string& inputPath, const std::string& outputPath,
+                    const LzssFrameSettings& settings) {
+    CheckDistinct(inputPath, outputPath);
+    InputMapping input(inputPath);
+    uint64_t contentSize = 0;
+    const bool framed = GetFramedContentSize(input.Data(), input.Size(), contentSize, settings);
+    OutputFile output(outputPath);
+    if (framed) {
+        uint8_t* target = output.Map(static_cast<size_t>(contentSize));
+        output.Finish(DecompressFramed(input.Data(), input.Size(), target, static_cast<size_t>(contentSize),
+                                       settings));
+        return;
+    }
+
+    // A raw stream does not record its size, so it is decoded into memory
+    std::vector<uint8_t> decoded;
+    DecompressData(input.Data(), input.Size(), decoded, settings.codec);
+    output.Write(decoded.data(), decoded.size());
+    output.Finish();
+}
+
+#else
+
+void CompressFile(const std::string& inputPath, const std::string& outputPath,
+                  const LzssFrameSettings& settings) {
+    CheckDistinct(inputPath, outputPath);
+    std::vector<uint8_t> input = ReadFile(inputPath);
+    std::vector<uint8_t> output;
+    CompressFramed(input.data(), input.size(), output, settings);
+    WriteFile(outputPath, output);
+}
+
+void DecompressFile(const std::string& inputPath, const std::string& outputPath,
+                    const LzssFrameSettings& settings) {
+    CheckDistinct(inputPath, outputPath);
+    std::vector<uint8_t> input = ReadFile(inputPath);
+    std::vector<uint8_t> output;
+    DecompressFramed(input.data(), input.size(), output, settings);
+    WriteFile(outputPath, output);
+}
+
+#endif
+
+} // namespace Compression
@@ -0,0 +1,28 @@
+#pragma once
+#ifndef LZSS_FILE_HPP
+#define LZSS_FILE_HPP
+
+#include "LzssFrame.hpp"
+#include <string>
+
+namespace Compression {
+
+// File-to-file helpers. The input is memory-mapped and handed to the
+// pointer-based codec directly; when the output size is bounded or known up
+// front (compression, decompression of a frame) the output file is sized with
+// ftruncate and mapped as well. Output is written in the LzssFrame format, so
+// inputs of up to one block produce a plain LZSS stream.
+//
+// The output goes to a temporary file next to outputPath that replaces it
+// only once everything is written, so a failure leaves no partial output and
+// an existing file untouched. A frame is checked before any output is sized.
+// I/O failures throw std::system_error, an outputPath naming the input file
+// std::invalid_argument.
+void CompressFile(const std::string& inputPath, const std::string& outputPath,
+                  const LzssFrameSettings& settings = LzssFrameSettings());
+void DecompressFile(const std::string& inputPath, const std::string& outputPath,
+                    const LzssFrameSettings& settings = LzssFrameSettings());
+
+} // namespace Compression
+
+#endif // LZSS_FILE_HPP
@@ -0,0 +1,415 @@
+#include "LzssFrame.hpp"
+#include "LzssParallel.hpp"
+#include "LzssChecksum.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
+
+namespace Compression {
+
+namespace {
+
+const uint8_t kFrameMagic[4] = { 'L', 'Z', 'S', 'F' };
+const size_t kFrameHeaderSize = 16;
+const size_t kBlockHeaderSize = 8;
+const size_t kChecksumSize = 4;
+const uint8_t kFlagSeekTable = 0x01;
+const uint8_t kFlagChecksum = 0x02;
+// Flags a newer format may add change the layout, so frames using them are
+// rejected rather than misread
+const uint8_t kKnownFlags = kFlagSeekTable | kFlagChecksum;
+const uint32_t kStoredBlock = 0x80000000u;
+// Input fed to the codec between two checks of a block being stored
+const size_t kStoreProbeSize = 0x10000;
+const uint8_t kSeekMagic[4] = { 'L', 'Z', 'S', 'T' };
+const size_t kSeekEntrySize = 8;
+const size_t kSeekFooterSize = 8;
+
+void PutLE(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+uint64_t GetLE(const uint8_t* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+struct BlockEntry {
+    size_t packedOffset;
+    size_t packedSize;
+    size_t rawOffset;
+    size_t rawSize;
+    bool stored;
+    bool checked;
+    uint32_t checksum;
+};
+
+size_t BlockHeaderSize(bool checksum) {
+    return kBlockHeaderSize + (checksum ? kChecksumSize : 0);
+}
+
+// True when input of inputSize bytes is always written as a plain stream
+bool WritesPlain(size_t inputSize, const LzssFrameSettings& settings) {
+    return inputSize <= settings.blockSize && !settings.seekable && !settings.checksum &&
+           (!settings.storeIncompressible || inputSize == 0);
+}
+
+// Compresses a block of a frame that stores incompressible blocks. The block
+// is fed to the codec in probe-sized steps, and a step after which the output
+// is no smaller than the input so far ends the attempt; the lookahead still
+// held by the codec only makes that check err towards compressing. Returns
+// true with the stream in packed when it is smaller than the block.
+bool PackBlock(const uint8_t* input, size_t size, const LzssSettings& settings, std::vector<uint8_t>& packed) {
+    LzssCompression lzss(true, settings);
+    for (size_t fed = 0; fed < size;) {
+        size_t step = std::min(kStoreProbeSize, size - fed);
+        lzss.Feed(input + fed, step, packed);
+        fed += step;
+        if (packed.size() >= fed) {
+            return false;
+        }
+    }
+    lzss.Finish(packed);
+    return packed.size() < size;
+}
+
+// Builds the block index of a frame and checks that it exactly covers both
+// the input and the recorded content size, that no block claims more raw
+// bytes than its packed bytes can hold, and that the frame version names
+// the token format of the codec settings. Block sizes come from the seek
+// table when the frame has one, so no block data is touched; otherwise the
+// block headers are walked.
+std::vector<BlockEntry> ParseBlocks(const uint8_t* input, size_t inputSize, const LzssSettings& settings) {
+    if (input[4] != static_cast<uint8_t>(GetTokenFormat(settings))) {
+        throw std::runtime_error("LZSS frame token format does not match the settings");
+    }
+    if ((input[5] & ~kKnownFlags) != 0) {
+        throw std::runtime_error("LZSS frame uses unsupported flags");
+    }
+    const uint64_t contentSize = GetLE(input + 8, 8);
+    const bool checked = (input[5] & kFlagChecksum) != 0;
+    const size_t headerSize = BlockHeaderSize(checked);
+    size_t blocksEnd = inputSize;
+    const uint8_t* table = nullptr;
+    size_t tableCount = 0;
+    if ((input[5] & kFlagSeekTable) != 0) {
+        if (inputSize - kFrameHeaderSize < kSeekFooterSize ||
+            std::memcmp(input + inputSize - 4, kSeekMagic, sizeof(kSeekMagic)) != 0) {
+            throw std::runtime_error("Corrupt LZSS frame");
+        }
+        tableCount = static_cast<size_t>(GetLE(input + inputSize - kSeekFooterSize, 4));
+        if (tableCount > (inputSize - kFrameHeaderSize - kSeekFooterSize) / kSeekEntrySize) {
+            throw std::runtime_error("Corrupt LZSS frame");
+        }
+        blocksEnd = inputSize - kSeekFooterSize - tableCount * kSeekEntrySize;
+        table = input + blocksEnd;
+    }
+
+    std::vector<BlockEntry> blocks;
+    blocks.reserve(tableCount);
+    size_t inPos = kFrameHeaderSize;
+    uint64_t outPos = 0;
+    while (inPos < blocksEnd) {
+        if (blocksEnd - inPos < headerSize || (table != nullptr && blocks.size() == tableCount)) {
+            throw std::runtime_error("Corrupt LZSS frame");
+        }
+        const uint8_t* sizes = table != nullptr ? table + blocks.size() * kSeekEntrySize : input + inPos;
+        BlockEntry block;
+        const uint32_t rawField = static_cast<uint32_t>(GetLE(sizes, 4));
+        block.stored = (rawField & kStoredBlock) != 0;
+        block.rawSize = rawField & ~kStoredBlock;
+        block.packedSize = static_cast<size_t>(GetLE(sizes + 4, 4));
+        block.packedOffset = inPos + headerSize;
+        block.checked = checked;
+        block.checksum = checked ? static_cast<uint32_t>(GetLE(input + inPos + kBlockHeaderSize, 4)) : 0;
+        block.rawOffset = static_cast<size_t>(outPos);
+        if (blocksEnd - block.packedOffset < block.packedSize || contentSize - outPos < block.rawSize ||
+            (block.stored ? block.packedSize != block.rawSize
+                          : block.rawSize > DecompressBound(block.packedSize, settings))) {
+            throw std::runtime_error("Corrupt LZSS frame");
+        }
+        blocks.push_back(block);
+        inPos = block.packedOffset + block.packedSize;
+        outPos += block.rawSize;
+    }
+    if (outPos != contentSize || (table != nullptr && blocks.size() != tableCount)) {
+        throw std::runtime_error("Corrupt LZSS frame");
+    }
+    return blocks;
+}
+
+// Decodes the first outputSize bytes of a block, checking its header against
+// the index entry; a block with a checksum must be decoded whole
+void DecodeBlock(const uint8_t* input, const BlockEntry& block, uint8_t* output, size_t outputSize,
+                 const LzssSettings& settings) {
+    const uint8_t* header = input + block.packedOffset - BlockHeaderSize(block.checked);
+    if (GetLE(header, 4) != (block.rawSize | (block.stored ? kStoredBlock : 0)) ||
+        GetLE(header + 4, 4) != block.packedSize) {
+        throw std::runtime_error("Corrupt LZSS frame");
+    }
+    if (block.stored) {
+        std::memcpy(output, input + block.packedOffset, outputSize);
+    } else {
+        size_t decoded = DecompressData(input + block.packedOffset, block.packedSize, output, outputSize, settings);
+        if (decoded != outputSize) {
+            throw std::runtime_error("Corrupt LZSS frame");
+        }
+    }
+    if (block.checked && Crc32c(output, outputSize) != block.checksum) {
+        throw std::runtime_error("LZSS block checksum mismatch");
+    }
+}
+
+// Runs job(i, codecSettings) for every block on the worker pool. One stats
+// object cannot take counts from concurrent codecs, so when the caller
+// collects statistics each block counts into its own and merges it on
+// completion.
+template <typename Job>
+void ForEachBlock(size_t count, const LzssFrameSettings& settings, Job&& job) {
+    LzssStats* const shared = settings.codec.stats;
+    if (shared == nullptr) {
+        detail::ParallelFor(count, settings.threadCount, [&](size_t i) { job(i, settings.codec); });
+        return;
+    }
+
+    std::mutex mutex;
+    detail::ParallelFor(count, settings.threadCount, [&](size_t i) {
+        LzssStats stats;
+        LzssSettings codec = settings.codec;
+        codec.stats = &stats;
+        job(i, codec);
+        std::lock_guard<std::mutex> lock(mutex);
+        *shared += stats;
+    });
+}
+
+// Decodes every block of the index into output, which holds the content size
+void DecodeBlocks(const uint8_t* input, const std::vector<BlockEntry>& blocks, uint8_t* output,
+                  const LzssFrameSettings& settings) {
+    ForEachBlock(blocks.size(), settings, [&](size_t i, const LzssSettings& codec) {
+        DecodeBlock(input, blocks[i], output + blocks[i].rawOffset, blocks[i].rawSize, codec);
+    });
+}
+
+} // namespace
+
+bool IsLzssFrame(const uint8_t* input, size_t inputSize) {
+    return inputSize >= kFrameHeaderSize &&
+           std::memcmp(input, kFrameMagic, sizeof(kFrameMagic)) == 0 &&
+           (input[4] == static_cast<uint8_t>(LzssTokenFormat::Classic) ||
+            input[4] == static_cast<uint8_t>(LzssTokenFormat::Wide));
+}
+
+size_t CompressFramedBound(size_t inputSize, const LzssFrameSettings& settings) {
+    if (settings.blockSize == 0 || settings.blockSize > UINT32_MAX / 2) {
+        throw std::invalid_argument("Unsupported block size");
+    }
+    if (WritesPlain(inputSize, settings)) {
+        return CompressBound(inputSize);
+    }
+
+    const size_t blockCount = (inputSize + settings.blockSize - 1) / settings.blockSize;
+    size_t bound = kFrameHeaderSize + blockCount * BlockHeaderSize(settings.checksum);
+    if (settings.storeIncompressible) {
+        bound += inputSize;
+    } else if (blockCount > 0) {
+        bound += (blockCount - 1) * CompressBound(settings.blockSize);
+        bound += CompressBound(inputSize - (blockCount - 1) * settings.blockSize);
+    }
+    if (settings.seekable) {
+        bound += blockCount * kSeekEntrySize + kSeekFooterSize;
+    }
+    return bound;
+}
+
+void CompressFramed(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output,
+                    const LzssFrameSettings& settings) {
+    const size_t bound = CompressFramedBound(inputSize, settings);
+    if (WritesPlain(inputSize, settings)) {
+        CompressData(input, inputSize, output, settings.codec);
+        return;
+    }
+
+    output.resize(bound);
+    output.resize(CompressFramed(input, inputSize, output.data(), output.size(), settings));
+}
+
+size_t CompressFramed(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity,
+                      const LzssFrameSettings& settings) {
+    const size_t bound = CompressFramedBound(inputSize, settings);
+    if (WritesPlain(inputSize, settings)) {
+        return CompressData(input, inputSize, output, outputCapacity, settings.codec);
+    }
+    if (outputCapacity < bound) {
+        throw std::length_error("Output buffer too small");
+    }
+
+    // Every block is compressed straight into a worst-case sized slot of the
+    // output, then the slots are moved down to close the gaps. Stored blocks
+    // leave their slot empty and are copied from the input instead.
+    const size_t blockCount = (inputSize + settings.blockSize - 1) / settings.blockSize;
+    const size_t headerSize = BlockHeaderSize(settings.checksum);
+    const size_t slotSize = headerSize +
+        (settings.storeIncompressible ? settings.blockSize : CompressBound(settings.blockSize));
+    uint8_t* slots = output + kFrameHeaderSize;
+    std::vector<size_t> packedSizes(blockCount);
+    std::vector<uint8_t> stored(blockCount, 0);
+    std::vector<uint32_t> checksums(settings.checksum ? blockCount : 0);
+    ForEachBlock(blockCount, settings, [&](size_t i, const LzssSettings& codec) {
+        size_t offset = i * settings.blockSize;
+        size_t size = std::min(settings.blockSize, inputSize - offset);
+        uint8_t* slot = slots + i * slotSize + headerSize;
+        if (settings.checksum) {
+            checksums[i] = Crc32c(input + offset, size);
+        }
+        if (!settings.storeIncompressible) {
+            packedSizes[i] = CompressData(input + offset, size, slot, CompressBound(size), codec);
+            return;
+        }
+        std::vector<uint8_t> packed;
+        if (PackBlock(input + offset, size, codec, packed)) {
+            std::memcpy(slot, packed.data(), packed.size());
+            packedSizes[i] = packed.size();
+        } else {
+            packedSizes[i] = size;
+            stored[i] = 1;
+        }
+    });
+    if (inputSize <= settings.blockSize && !settings.seekable && !settings.checksum && stored[0] == 0) {
+        // A single block that shrinks is still written as a plain stream
+        std::memmove(output, slots + headerSize, packedSizes[0]);
+        return packedSizes[0];
+    }
+
+    uint8_t* out = output;
+    std::memcpy(out, kFrameMagic, sizeof(kFrameMagic));
+    out[4] = static_cast<uint8_t>(GetTokenFormat(settings.codec));
+    out[5] = (settings.seekable ? kFlagSeekTable : 0) | (settings.checksum ? kFlagChecksum : 0);
+    PutLE(out + 6, 0, 2);
+    PutLE(out + 8, inputSize, 8);
+    out += kFrameHeaderSize;
+    for (size_t i = 0; i < blockCount; i++) {
+        size_t size = std::min(settings.blockSize, inputSize - i * settings.blockSize);
+        PutLE(out, size | (stored[i] != 0 ? kStoredBlock : 0), 4);
+        PutLE(out + 4, packedSizes[i], 4);
+        if (settings.checksum) {
+            PutLE(out + kBlockHeaderSize, checksums[i], 4);
+        }
+        if (stored[i] != 0) {
+            std::memcpy(out + headerSize, input + i * settings.blockSize, size);
+        } else {
+            std::memmove(out + headerSize, slots + i * slotSize + headerSize, packedSizes[i]);
+        }
+        out += headerSize + packedSizes[i];
+    }
+    if (settings.seekable) {
+        for (size_t i = 0; i < blockCount; i++) {
+            size_t size = std::min(settings.blockSize, inputSize - i * settings.blockSize);
+            PutLE(out, size | (stored[i] != 0 ? kStoredBlock : 0), 4);
+            PutLE(out + 4, packedSizes[i], 4);
+            out += kSeekEntrySize;
+        }
+        PutLE(out, blockCount, 4);
+        std::memcpy(out + 4, kSeekMagic, sizeof(kSeekMagic));
+        out += kSeekFooterSize;
+    }
+    return out - output;
+}
+
+bool GetFramedContentSize(const uint8_t* input, size_t inputSize, uint64_t& contentSize,
+                          const LzssFrameSettings& settings) {
+    if (!IsLzssFrame(input, inputSize)) {
+        return false;
+    }
+    ParseBlocks(input, inputSize, settings.codec);
+    contentSize = GetLE(input + 8, 8);
+    return true;
+}
+
+void DecompressFramed(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output,
+                      const LzssFrameSettings& settings) {
+    if (!IsLzssFrame(input, inputSize)) {
+        DecompressData(input, inputSize, output, settings.codec);
+        return;
+    }
+
+    // The index is checked before the output is sized, so a forged content
+    // size cannot ask for more than the blocks can decode to
+    const std::vector<BlockEntry> blocks = ParseBlocks(input, inputSize, settings.codec);
+    output.resize(static_cast<size_t>(GetLE(input + 8, 8)));
+    DecodeBlocks(input, blocks, output.data(), settings);
+}
+
+size_t DecompressFramed(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity,
+                        const LzssFrameSettings& settings) {
+    if (!IsLzssFrame(input, inputSize)) {
+        return DecompressData(input, inputSize, output, outputCapacity, settings.codec);
+    }
+
+    const std::vector<BlockEntry> blocks = ParseBlocks(input, inputSize, settings.codec);
+    const uint64_t contentSize = GetLE(input + 8, 8);
+    if (outputCapacity < contentSize) {
+        throw std::length_error("Output buffer too small");
+    }
+
+    DecodeBlocks(input, blocks, output, settings);
+    return static_cast<size_t>(contentSize);
+}
+
+void DecompressRange(const uint8_t* input, size_t inputSize, uint64_t offset, size_t length,
+                     std::vector<uint8_t>& output, const LzssFrameSettings& settings) {
+    if (!IsLzssFrame(input, inputSize)) {
+        // A raw stream has no sync points, so decode up to the end of the range.
+        // The range is checked against what the input can decode to before
+        // the prefix is sized.
+        const size_t bound = DecompressBound(inputSize, settings.codec);
+        if (offset > bound || bound - offset < length) {
+            throw std::out_of_range("Range exceeds the compressed content");
+        }
+        std::vector<uint8_t> prefix(static_cast<size_t>(offset) + length);
+        if (DecompressData(input, inputSize, prefix.data(), prefix.size(), settings.codec) != prefix.size()) {
+            throw std::out_of_range("Range exceeds the compressed content");
+        }
+        output.assign(prefix.begin() + static_cast<size_t>(offset), prefix.end());
+        return;
+    }
+
+    const std::vector<BlockEntry> blocks = ParseBlocks(input, inputSize, settings.codec);
+    const uint64_t contentSize = GetLE(input + 8, 8);
+    if (offset > contentSize || contentSize - offset < length) {
+        throw std::out_of_range("Range exceeds the compressed content");
+    }
+    output.resize(length);
+    if (length == 0) {
+        return;
+    }
+
+    const uint64_t end = offset + length;
+    auto first = std::upper_bound(blocks.begin(), blocks.end(), offset,
+        [](uint64_t value, const BlockEntry& block) { return value < block.rawOffset + block.rawSize; });
+    auto last = std::lower_bound(first, blocks.end(), end,
+        [](const BlockEntry& block, uint64_t value) { return block.rawOffset < value; });
+
+    ForEachBlock(last - first, settings, [&](size_t i, const LzssSettings& codec) {
+        const BlockEntry& block = first[i];
+        size_t skip = offset > block.rawOffset ? static_cast<size_t>(offset - block.rawOffset) : 0;
+        size_t wanted = static_cast<size_t>(std::min<uint64_t>(end - block.rawOffset, block.rawSize));
+        size_t needed = block.checked ? block.rawSize : wanted;
+        uint8_t* target = output.data() + (block.rawOffset + skip - offset);
+        if (skip == 0 && needed == wanted) {
+            DecodeBlock(input, block, target, needed, codec);
+        } else {
+            std::vector<uint8_t> scratch(needed);
+            DecodeBlock(input, block, scratch.data(), needed, codec);
+            std::memcpy(target, scratch.data() + skip, wanted - skip);
+        }
+    });
+}
+
+} // namespace Compression
@@ -0,0 +1,98 @@
+#pragma once
+#ifndef LZSS_FRAME_HPP
+#define LZSS_FRAME_HPP
+
+#include "Lzss.hpp"
+
+namespace Compression {
+
+// Framed container for block-parallel compression. Input larger than one
+// block is split into independently compressed blocks:
+//
+//   frame header  "LZSF", u8 version, u8 flags, u16 reserved, u64 contentSize
+//   per block     u32 rawSize, u32 packedSize, packedSize bytes of LZSS
+//
+// With a seek table, flag bit 0 is set and the blocks are followed by
+//
+//   seek table    per block u32 rawSize, u32 packedSize
+//   footer        u32 blockCount, "LZST"
+//
+// so a reader can locate any block without walking the frame. Bit 31 of a
+// rawSize field marks a stored block, whose packedSize bytes are the raw data
+// itself; the rest is the size. With checksums, flag bit 1 is set and every
+// block header carries a third field, the u32 CRC-32C (see Crc32c()) of the
+// block's raw data, which the decoder checks each block it decodes against.
+// Other flag bits are reserved; a decoder rejects frames that set them.
+//
+// The version is the LzssTokenFormat of the block codec, so a decoder given
+// settings with another token format rejects the frame rather than producing
+// garbage. All integers are little-endian. Input that fits into a single
+// block is written as a plain LZSS stream, identical to CompressData(), so
+// existing decoders keep working on small inputs; seekable or checksummed
+// output is always framed, and so is a single block that gets stored.
+struct LzssFrameSettings {
+    // Settings of the LZSS codec run on every block
+    LzssSettings codec;
+    // Uncompressed bytes per block
+    size_t blockSize = 1 << 20;
+    // Worker threads; 0 uses one per hardware thread
+    size_t threadCount = 0;
+    // Append a seek table so DecompressRange() can go straight to a block
+    bool seekable = false;
+    // Store blocks that do not shrink instead of compressing them. Each block
+    // is compressed in steps and given up on as soon as its output has caught
+    // up with the input consumed, so already compressed data costs a fraction
+    // of a full pass and grows by no more than the block header. A block
+    // whose first steps do not shrink is stored whole, so data mixing both
+    // kinds is better served by smaller blocks
+    bool storeIncompressible = false;
+    // Record a CRC-32C of every block. The worker that codes a block also
+    // checksums it, just before compressing or just after decoding it, so
+    // the data is checked while it is still in cache
+    bool checksum = false;
+};
+
+// True when data starts with a frame header rather than a raw LZSS stream
+bool IsLzssFrame(const uint8_t* input, size_t inputSize);
+
+// Largest possible CompressFramed() output for inputSize bytes
+size_t CompressFramedBound(size_t inputSize, const LzssFrameSettings& settings = LzssFrameSettings());
+
+// Compresses input into output (replacing its contents), spreading the
+// blocks over a pool of worker threads
+void CompressFramed(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output,
+                    const LzssFrameSettings& settings = LzssFrameSettings());
+// Same, into a caller buffer of at least CompressFramedBound() bytes (a
+// framed output throws std::length_error otherwise); returns the size written
+size_t CompressFramed(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity,
+                      const LzssFrameSettings& settings = LzssFrameSettings());
+
+// Stores the uncompressed size recorded in a frame header; returns false for
+// raw LZSS streams, which do not record it. The block index is checked
+// against the size first, so a malformed frame throws std::runtime_error
+// rather than reporting a size its blocks cannot produce.
+bool GetFramedContentSize(const uint8_t* input, size_t inputSize, uint64_t& contentSize,
+                          const LzssFrameSettings& settings = LzssFrameSettings());
+
+// Decodes either a frame or a raw LZSS stream into output (replacing its
+// contents). The blocks of a frame are decoded concurrently into disjoint
+// parts of the output. Throws std::runtime_error when a frame is malformed
+// or a block does not match its checksum.
+void DecompressFramed(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output,
+                      const LzssFrameSettings& settings = LzssFrameSettings());
+// Same, decoding into a preallocated buffer of at least the content size
+// (std::length_error otherwise); raw streams are cut at outputCapacity
+size_t DecompressFramed(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity,
+                        const LzssFrameSettings& settings = LzssFrameSettings());
+
+// Decodes length bytes starting at uncompressed offset into output (replacing
+// its contents), decoding only the blocks that cover the range. Frames
+// without a seek table are indexed from their block headers; raw streams are
+// decoded from the start. Blocks with a checksum are decoded whole so they
+// can be verified. Throws std::out_of_range past the end of content.
+void DecompressRange(const uint8_t* input, size_t inputSize, uint64_t offset, size_t length,
+                     std::vector<uint8_t>& output, const LzssFrameSettings& settings = LzssFrameSettings());
+
+} // namespace Compression
+
+#endif // LZSS_FRAME_HPP
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef LZSS_PARALLEL_HPP
+#define LZSS_PARALLEL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Compression {
+namespace detail {
+
+// Number of workers to use for count independent jobs; 0 requests one per
+// hardware thread
+inline size_t WorkerCount(size_t requested, size_t count) {
+    size_t workers = requested != 0 ? requested : std::thread::hardware_concurrency();
+    if (workers == 0) {
+        workers = 1;
+    }
+    return workers < count ? workers : count;
+}
+
+// Runs job(index) for every index in [0, count) on up to `threads` workers
+// that pull indices from a shared counter. The first exception thrown by any
+// job is rethrown on the calling thread once all workers have stopped.
+template <typename Job>
+void ParallelFor(size_t count, size_t threads, Job job) {
+    const size_t workers = WorkerCount(threads, count);
+    if (workers <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            job(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex errorLock;
+    auto run = [&]() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < count) {
+            try {
+                job(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(errorLock);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = count;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (size_t w = 1; w < workers; w++) {
+        pool.emplace_back(run);
+    }
+    run();
+    for (std::thread& t : pool) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace detail
+} // namespace Compression
+
+#endif // LZSS_PARALLEL_HPP
@@ -0,0 +1,446 @@
+#include "LzssPipeline.hpp"
+#include "LzssParallel.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace Compression {
+
+namespace {
+
+// A block on its way through the pipeline. history holds the input that
+// precedes data, of which the codec keeps the last window's worth.
+struct PipelineBlock {
+    size_t index;
+    uint64_t offset;
+    const uint8_t* history;
+    size_t historySize;
+    const uint8_t* data;
+    size_t size;
+    // Stream input: the last window of the previous block, then the block
+    std::vector<uint8_t> storage;
+    std::vector<uint8_t> packed;
+};
+
+// Hands out blocks that point into input in memory
+class MemorySource {
+public:
+    MemorySource(const uint8_t* input, size_t inputSize, size_t blockSize)
+        : input_(input)
+        , inputSize_(inputSize)
+        , blockSize_(blockSize)
+        , offset_(0)
+    {
+    }
+
+    bool Next(PipelineBlock& block) {
+        if (offset_ == inputSize_) {
+            return false;
+        }
+        block.offset = offset_;
+        block.history = input_;
+        block.historySize = offset_;
+        block.data = input_ + offset_;
+        block.size = std::min(blockSize_, inputSize_ - offset_);
+        offset_ += block.size;
+        return true;
+    }
+
+private:
+    const uint8_t* input_;
+    size_t inputSize_;
+    size_t blockSize_;
+    size_t offset_;
+};
+
+// Reads blocks from a stream, carrying the window that ends each block over
+// to the next one
+class StreamSource {
+public:
+    StreamSource(std::istream& input, size_t blockSize, size_t windowSize)
+        : input_(input)
+        , blockSize_(blockSize)
+        , windowSize_(windowSize)
+        , offset_(0)
+    {
+    }
+
+    bool Next(PipelineBlock& block) {
+        if (!input_) {
+            return false;
+        }
+        const size_t carried = tail_.size();
+        block.storage.resize(carried + blockSize_);
+        std::copy(tail_.begin(), tail_.end(), block.storage.begin());
+        input_.read(reinterpret_cast<char*>(block.storage.data() + carried), blockSize_);
+        const size_t size = static_cast<size_t>(input_.gcount());
+        if (size == 0) {
+            return false;
+        }
+        block.storage.resize(carried + size);
+        block.offset = offset_;
+        block.history = block.storage.data();
+        block.historySize = carried;
+        block.data = block.storage.data() + carried;
+        block.size = size;
+        offset_ += size;
+
+        const size_t keep = std::min(windowSize_, block.storage.size());
+        tail_.assign(block.storage.end() - keep, block.storage.end());
+        return true;
+    }
+
+private:
+    std::istream& input_;
+    size_t blockSize_;
+    size_t windowSize_;
+    uint64_t offset_;
+    std::vector<uint8_t> tail_;
+};
+
+class VectorSink {
+public:
+    explicit VectorSink(std::vector<uint8_t>& output)
+        : output_(output)
+    {
+    }
+
+    void Write(const uint8_t* data, size_t size) {
+        output_.insert(output_.end(), data, data + size);
+    }
+
+private:
+    std::vector<uint8_t>& output_;
+};
+
+class StreamSink {
+public:
+    explicit StreamSink(std::ostream& output)
+        : output_(output)
+    {
+    }
+
+    void Write(const uint8_t* data, size_t size) {
+        output_.write(reinterpret_cast<const char*>(data), size);
+        if (!output_) {
+            throw std::runtime_error("Failed to write LZSS output");
+        }
+    }
+
+private:
+    std::ostream& output_;
+};
+
+size_t LiteralCount(uint32_t flags) {
+    size_t count = 0;
+    for (; flags != 0; flags &= flags - 1) {
+        count++;
+    }
+    return count;
+}
+
+// Re-packs the tokens of consecutive LZSS streams into one stream, as if a
+// single encoder had written them all. A stream ends with a partial flag
+// group, which the next one has to continue rather than start a new group.
+// The joined groups stay the same number of tokens out of step with the
+// stream's own throughout it, so each group is split at most once and moved
+// in bulk; only the flag bytes are rebuilt.
+class TokenJoiner {
+public:
+    explicit TokenJoiner(size_t matchSize)
+        : matchSize_(matchSize)
+        , groupSize_(1)
+        , tokens_(0)
+    {
+        group_[0] = 0;
+    }
+
+    void Append(const uint8_t* stream, size_t size, std::vector<uint8_t>& output) {
+        size_t pos = 0;
+        while (pos < size) {
+            const uint32_t flags = stream[pos++];
+            // Only the last group of a stream can be partial
+            size_t count = 8;
+            size_t length = TokenBytes(flags, 8);
+            if (size - pos < length) {
+                length = 0;
+                for (count = 0; count < 8 && pos + length < size; count++) {
+                    length += (flags >> count & 1) != 0 ? 1 : matchSize_;
+                }
+                if (pos + length != size) {
+                    throw std::runtime_error("Truncated LZSS token");
+                }
+            }
+            Put(flags, count, stream + pos, output);
+            pos += length;
+        }
+    }
+
+    // Writes the partial group still held
+    void Finish(std::vector<uint8_t>& output) {
+        if (tokens_ != 0) {
+            output.insert(output.end(), group_, group_ + groupSize_);
+            group_[0] = 0;
+            groupSize_ = 1;
+            tokens_ = 0;
+        }
+    }
+
+private:
+    // Bytes taken by the first count tokens of a group
+    size_t TokenBytes(uint32_t flags, size_t count) const {
+        const size_t literals = LiteralCount(flags & ((1u << count) - 1));
+        return literals + (count - literals) * matchSize_;
+    }
+
+    void Put(uint32_t flags, size_t count, const uint8_t* tokens, std::vector<uint8_t>& output) {
+        while (count > 0) {
+            const size_t take = std::min(count, 8 - tokens_);
+            const size_t length = TokenBytes(flags, take);
+            if (tokens_ == 0 && take == 8) {
+                output.push_back(static_cast<uint8_t>(flags));
+                output.insert(output.end(), tokens, tokens + length);
+            } else {
+                group_[0] |= static_cast<uint8_t>((flags & ((1u << take) - 1)) << tokens_);
+                std::memcpy(group_ + groupSize_, tokens, length);
+                groupSize_ += length;
+                tokens_ += take;
+                if (tokens_ == 8) {
+                    output.insert(output.end(), group_, group_ + groupSize_);
+                    group_[0] = 0;
+                    groupSize_ = 1;
+                    tokens_ = 0;
+                }
+            }
+            flags >>= take;
+            tokens += length;
+            count -= take;
+        }
+    }
+
+    size_t matchSize_;
+    uint8_t group_[25];
+    size_t groupSize_;
+    size_t tokens_;
+};
+
+// Compresses a block as the sequential encoder would continue at its offset:
+// the window position moves on by the offset and the preceding input is
+// primed as a dictionary, so every match the block's tokens refer to holds
+// the same bytes in the decoder's window
+void CompressBlock(PipelineBlock& block, const LzssSettings& settings) {
+    if (block.offset == 0) {
+        CompressData(block.data, block.size, block.packed, settings);
+        return;
+    }
+    LzssSettings codec = settings;
+    const uint64_t mask = static_cast<uint64_t>(codec.frameSize - 1);
+    codec.frameInitPos = static_cast<int32_t>((codec.frameInitPos + block.offset) & mask);
+    codec.dictionary = nullptr;
+    LzssSettings primed = codec;
+    primed.stats = nullptr;
+    LzssDictionary history(block.history, block.historySize, primed);
+    codec.dictionary = &history;
+    CompressData(block.data, block.size, block.packed, codec);
+}
+
+// Runs the three stages over the blocks source hands out: the calling thread
+// reads, the workers compress and a writer thread joins the results in
+// order into sink. At most two blocks per worker are in flight; their
+// buffers are recycled, so memory stays bounded whatever the input size.
+template <typename Source, typename Sink>
+void RunPipeline(Source& source, Sink& sink, size_t workers, const LzssPipelineSettings& settings) {
+    const size_t limit = workers * 2;
+    const size_t matchSize = GetTokenFormat(settings.codec) == LzssTokenFormat::Wide ? 3 : 2;
+
+    std::mutex mutex;
+    std::condition_variable compressible;
+    std::condition_variable writable;
+    std::condition_variable reusable;
+    std::deque<PipelineBlock*> queue;
+    // Compressed blocks by index modulo limit; indices in flight are never
+    // limit or more apart
+    std::vector<PipelineBlock*> compressed(limit, nullptr);
+    std::vector<std::unique_ptr<PipelineBlock>> blocks;
+    std::vector<PipelineBlock*> free;
+    size_t inFlight = 0;
+    size_t readCount = 0;
+    bool readDone = false;
+    bool failed = false;
+    std::exception_ptr error;
+    std::vector<LzssStats> stats(settings.codec.stats != nullptr ? workers : 0);
+
+    auto fail = [&](std::exception_ptr exception) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+            error = exception;
+        }
+        failed = true;
+        compressible.notify_all();
+        writable.notify_all();
+        reusable.notify_all();
+    };
+
+    auto compress = [&](size_t w) {
+        LzssSettings codec = settings.codec;
+        if (codec.stats != nullptr) {
+            codec.stats = &stats[w];
+        }
+        for (;;) {
+            std::unique_lock<std::mutex> lock(mutex);
+            compressible.wait(lock, [&] { return failed || readDone || !queue.empty(); });
+            if (failed || queue.empty()) {
+                return;
+            }
+            PipelineBlock* block = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            try {
+                CompressBlock(*block, codec);
+            } catch (...) {
+                fail(std::current_exception());
+                return;
+            }
+            lock.lock();
+            compressed[block->index % limit] = block;
+            writable.notify_one();
+        }
+    };
+
+    auto write = [&]() {
+        TokenJoiner joiner(matchSize);
+        std::vector<uint8_t> joined;
+        try {
+            for (size_t next = 0;; next++) {
+                std::unique_lock<std::mutex> lock(mutex);
+                PipelineBlock*& slot = compressed[next % limit];
+                writable.wait(lock, [&] { return failed || slot != nullptr || (readDone && next == readCount); });
+                if (failed || slot == nullptr) {
+                    break;
+                }
+                PipelineBlock* block = slot;
+                slot = nullptr;
+                lock.unlock();
+
+                joined.clear();
+                joiner.Append(block->packed.data(), block->packed.size(), joined);
+                sink.Write(joined.data(), joined.size());
+
+                lock.lock();
+                free.push_back(block);
+                inFlight--;
+                reusable.notify_one();
+            }
+            joined.clear();
+            joiner.Finish(joined);
+            sink.Write(joined.data(), joined.size());
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(workers + 1);
+    try {
+        for (size_t w = 0; w < workers; w++) {
+            pool.emplace_back(compress, w);
+        }
+        pool.emplace_back(write);
+    } catch (...) {
+        fail(std::current_exception());
+    }
+
+    for (;;) {
+        PipelineBlock* block;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            reusable.wait(lock, [&] { return failed || inFlight < limit; });
+            if (failed) {
+                break;
+            }
+            if (free.empty()) {
+                blocks.emplace_back(new PipelineBlock());
+                free.push_back(blocks.back().get());
+            }
+            block = free.back();
+            free.pop_back();
+            inFlight++;
+        }
+        bool more;
+        try {
+            more = source.Next(*block);
+        } catch (...) {
+            fail(std::current_exception());
+            break;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!more) {
+            readDone = true;
+            compressible.notify_all();
+            writable.notify_all();
+            break;
+        }
+        block->index = readCount++;
+        queue.push_back(block);
+        compressible.notify_one();
+    }
+
+    for (std::thread& t : pool) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    for (const LzssStats& worker : stats) {
+        *settings.codec.stats += worker;
+    }
+}
+
+} // namespace
+
+void CompressPipelined(std::istream& input, std::ostream& output, const LzssPipelineSettings& settings) {
+    if (settings.blockSize == 0) {
+        throw std::invalid_argument("Unsupported block size");
+    }
+    const size_t workers = detail::WorkerCount(settings.threadCount, std::numeric_limits<size_t>::max());
+    if (workers <= 1) {
+        LzssCompression lzss(input, output, true, settings.codec);
+        lzss.Compress();
+        if (!output) {
+            throw std::runtime_error("Failed to write LZSS output");
+        }
+        return;
+    }
+
+    const size_t windowSize = static_cast<size_t>(settings.codec.frameSize - settings.codec.maxMatchLength);
+    StreamSource source(input, settings.blockSize, windowSize);
+    StreamSink sink(output);
+    RunPipeline(source, sink, workers, settings);
+}
+
+void CompressPipelined(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output,
+                       const LzssPipelineSettings& settings) {
+    if (settings.blockSize == 0) {
+        throw std::invalid_argument("Unsupported block size");
+    }
+    const size_t blockCount = (inputSize + settings.blockSize - 1) / settings.blockSize;
+    const size_t workers = detail::WorkerCount(settings.threadCount, blockCount);
+    if (workers <= 1) {
+        CompressData(input, inputSize, output, settings.codec);
+        return;
+    }
+
+    output.clear();
+    output.reserve(CompressBound(inputSize));
+    MemorySource source(input, inputSize, settings.blockSize);
+    VectorSink sink(output);
+    RunPipeline(source, sink, workers, settings);
+}
+
+} // namespace Compression
@@ -0,0 +1,49 @@
+#pragma once
+#ifndef LZSS_PIPELINE_HPP
+#define LZSS_PIPELINE_HPP
+
+#include "Lzss.hpp"
+
+namespace Compression {
+
+// Parallel compression of one sequential stream into a plain LZSS stream,
+// which every decoder reads like the output of CompressData(). The input is
+// cut into blocks that are compressed concurrently, but unlike the blocks of
+// an LzssFrame they are not independent: each block's codec starts where a
+// sequential encoder would be at that offset, with the window position
+// advanced accordingly and the preceding frameSize - maxMatchLength bytes of
+// input preset as history (see LzssDictionary), so matches reach back across
+// block boundaries. The flag groups of the blocks are then re-packed into
+// one continuous stream. Only a block's last few tokens differ, as they
+// cannot run past its end, so the ratio stays within a fraction of a
+// percent of the sequential Compress() once blocks are much larger than the
+// window.
+//
+// Reading, compressing and writing run as stages of a pipeline: the calling
+// thread reads blocks, the workers compress them in any order and a writer
+// thread joins them in input order, with about two blocks per worker in
+// flight. A codec dictionary applies to the first block only; later blocks
+// take their history from the input. With stats set in the codec settings,
+// each worker counts into its own LzssStats and the totals are added to it
+// at the end.
+struct LzssPipelineSettings {
+    // Settings of the LZSS codec run on every block
+    LzssSettings codec;
+    // Uncompressed bytes per block
+    size_t blockSize = 1 << 20;
+    // Worker threads; 0 uses one per hardware thread. A single worker runs
+    // the sequential codec, which gives the same bytes as CompressData()
+    size_t threadCount = 0;
+};
+
+// Compresses everything read from input into output. Throws
+// std::runtime_error when output fails.
+void CompressPipelined(std::istream& input, std::ostream& output,
+                       const LzssPipelineSettings& settings = LzssPipelineSettings());
+// Same for input in memory, into output (replacing its contents)
+void CompressPipelined(const uint8_t* input, size_t inputSize, std::vector<uint8_t>& output,
+                       const LzssPipelineSettings& settings = LzssPipelineSettings());
+
+} // namespace Compression
+
+#endif // LZSS_PIPELINE_HPP
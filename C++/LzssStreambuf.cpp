@@ -0,0 +1,173 @@
+#include "LzssStreambuf.hpp"
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <ostream>
+
+namespace Compression {
+
+LzssOStreambuf::LzssOStreambuf(std::ostream& sink, const LzssSettings& settings)
+    : codec_(true, settings)
+    , sink_(sink)
+    , buffer_(std::max<int32_t>(settings.ioBufferSize, 1))
+    , finished_(true)
+{
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+LzssOStreambuf::~LzssOStreambuf() {
+    if (!finished_ || pptr() != pbase()) {
+        try {
+            Finish();
+        } catch (...) {
+        }
+    }
+}
+
+bool LzssOStreambuf::Flush() {
+    if (!EncodeBuffer()) {
+        return false;
+    }
+    codec_.Flush(packed_);
+    return Drain() && sink_.flush();
+}
+
+bool LzssOStreambuf::Finish() {
+    if (!EncodeBuffer()) {
+        return false;
+    }
+    codec_.Finish(packed_);
+    finished_ = true;
+    return Drain() && sink_.flush();
+}
+
+LzssOStreambuf::int_type LzssOStreambuf::overflow(int_type ch) {
+    if (!EncodeBuffer()) {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize LzssOStreambuf::xsputn(const char* s, std::streamsize n) {
+    const size_t size = static_cast<size_t>(n);
+    if (size <= static_cast<size_t>(epptr() - pptr())) {
+        std::memcpy(pptr(), s, size);
+        pbump(static_cast<int>(size));
+        return n;
+    }
+
+    // Whole chunks are fed from the caller's memory, one at a time so the
+    // tokens waiting for the sink stay bounded; the tail is buffered
+    if (!EncodeBuffer()) {
+        return 0;
+    }
+    size_t done = 0;
+    for (; size - done >= buffer_.size(); done += buffer_.size()) {
+        if (!Encode(s + done, buffer_.size())) {
+            return static_cast<std::streamsize>(done);
+        }
+    }
+    std::memcpy(pptr(), s + done, size - done);
+    pbump(static_cast<int>(size - done));
+    return n;
+}
+
+int LzssOStreambuf::sync() {
+    return EncodeBuffer() && sink_.flush() ? 0 : -1;
+}
+
+// Feeds size bytes to the codec and passes the tokens it decides on to the sink
+bool LzssOStreambuf::Encode(const char* data, size_t size) {
+    finished_ = false;
+    codec_.Feed(reinterpret_cast<const uint8_t*>(data), size, packed_);
+    return Drain();
+}
+
+bool LzssOStreambuf::EncodeBuffer() {
+    const size_t size = pptr() - pbase();
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+    return size == 0 || Encode(buffer_.data(), size);
+}
+
+bool LzssOStreambuf::Drain() {
+    if (!packed_.empty()) {
+        sink_.write(reinterpret_cast<const char*>(packed_.data()), packed_.size());
+        packed_.clear();
+    }
+    return static_cast<bool>(sink_);
+}
+
+LzssIStreambuf::LzssIStreambuf(std::istream& source, const LzssSettings& settings)
+    : codec_(false, settings)
+    , source_(source)
+    , input_(std::max<int32_t>(settings.ioBufferSize, 1))
+    , inputPos_(0)
+    , inputEnd_(0)
+    , buffer_(std::max<int32_t>(settings.ioBufferSize, 1))
+{
+    setg(buffer_.data(), buffer_.data(), buffer_.data());
+}
+
+LzssIStreambuf::int_type LzssIStreambuf::underflow() {
+    if (gptr() == egptr()) {
+        size_t size = Decode(buffer_.data(), buffer_.size());
+        if (size == 0) {
+            return traits_type::eof();
+        }
+        setg(buffer_.data(), buffer_.data(), buffer_.data() + size);
+    }
+    return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize LzssIStreambuf::xsgetn(char* s, std::streamsize n) {
+    const size_t size = static_cast<size_t>(n);
+    size_t done = 0;
+    while (done < size) {
+        if (gptr() != egptr()) {
+            size_t part = std::min<size_t>(egptr() - gptr(), size - done);
+            std::memcpy(s + done, gptr(), part);
+            gbump(static_cast<int>(part));
+            done += part;
+        } else if (size - done >= buffer_.size()) {
+            // Large reads are decoded straight into the caller's memory
+            size_t part = Decode(s + done, size - done);
+            if (part == 0) {
+                break;
+            }
+            done += part;
+        } else if (traits_type::eq_int_type(underflow(), traits_type::eof())) {
+            break;
+        }
+    }
+    return static_cast<std::streamsize>(done);
+}
+
+// Decodes until output is full or the source ends; returns the bytes written.
+// The codec may still hold the rest of a match when the input runs out, so
+// the source is only read once a step makes no progress.
+size_t LzssIStreambuf::Decode(char* output, size_t capacity) {
+    size_t written = 0;
+    while (written < capacity) {
+        size_t used = 0;
+        size_t part = codec_.DecompressStep(reinterpret_cast<const uint8_t*>(input_.data()) + inputPos_,
+                                            inputEnd_ - inputPos_, used,
+                                            reinterpret_cast<uint8_t*>(output) + written, capacity - written);
+        inputPos_ += used;
+        written += part;
+        if (part == 0 && used == 0) {
+            source_.read(input_.data(), input_.size());
+            inputPos_ = 0;
+            inputEnd_ = static_cast<size_t>(source_.gcount());
+            if (inputEnd_ == 0) {
+                break;
+            }
+        }
+    }
+    return written;
+}
+
+} // namespace Compression
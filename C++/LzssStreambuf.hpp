@@ -0,0 +1,76 @@
+#pragma once
+#ifndef LZSS_STREAMBUF_HPP
+#define LZSS_STREAMBUF_HPP
+
+#include "Lzss.hpp"
+#include <streambuf>
+
+namespace Compression {
+
+// std::streambuf adapters that put the incremental codec into an iostream
+// pipeline, for example
+//
+//   LzssOStreambuf packed(file);
+//   std::ostream log(&packed);
+//
+// Memory stays at a few ioBufferSize chunks whatever the amount of data.
+// Writes and reads that fit are gathered in a chunk-sized buffer; larger
+// ones bypass it, going to the codec or being decoded straight from and into
+// the caller's memory. The codec uses settings.ioBufferSize for its chunks.
+
+// Compresses everything written to it into sink, which must outlive it
+class LzssOStreambuf : public std::streambuf {
+public:
+    explicit LzssOStreambuf(std::ostream& sink, const LzssSettings& settings = LzssSettings());
+    // Finishes the stream unless Finish() was called; errors are ignored
+    ~LzssOStreambuf() override;
+
+    // Makes everything written so far decodable, like LzssCompression::Flush().
+    // A stream flush does less, as flushing on every line would cost ratio:
+    // it hands the buffered bytes to the codec and writes out the tokens
+    // already decided. Both return false when the sink fails.
+    bool Flush();
+    // Ends the stream; the next write starts a new one right after it in the
+    // sink, from a fresh window, so each decodes on its own
+    bool Finish();
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int sync() override;
+
+private:
+    bool Encode(const char* data, size_t size);
+    bool EncodeBuffer();
+    bool Drain();
+
+    LzssCompression codec_;
+    std::ostream& sink_;
+    std::vector<char> buffer_;
+    std::vector<uint8_t> packed_;
+    bool finished_;
+};
+
+// Decompresses the LZSS stream read from source, which must outlive it
+class LzssIStreambuf : public std::streambuf {
+public:
+    explicit LzssIStreambuf(std::istream& source, const LzssSettings& settings = LzssSettings());
+
+protected:
+    int_type underflow() override;
+    std::streamsize xsgetn(char* s, std::streamsize n) override;
+
+private:
+    size_t Decode(char* output, size_t capacity);
+
+    LzssCompression codec_;
+    std::istream& source_;
+    std::vector<char> input_;
+    size_t inputPos_;
+    size_t inputEnd_;
+    std::vector<char> buffer_;
+};
+
+} // namespace Compression
+
+#endif // LZSS_STREAMBUF_HPP
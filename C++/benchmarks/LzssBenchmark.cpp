@@ -0,0 +1,408 @@
+#include "Lzss.hpp"
+#include "LzssBatch.hpp"
+#include "LzssPipeline.hpp"
+#include "LzssStreambuf.hpp"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+
+using namespace Compression;
+
+namespace {
+
+const size_t kCorpusSize = 1 << 20;
+
+// Synthetic stand-ins for the usual corpora, generated with fixed seeds so
+// runs are comparable
+enum Corpus { Text, Binary, Zeros, Random, CorpusCount };
+
+const char* const kCorpusNames[] = { "text", "binary", "zeros", "random" };
+
+// English-like prose: words drawn from a small vocabulary with a skewed
+// distribution, grouped into sentences and lines
+std::vector<uint8_t> MakeText() {
+    static const char* const words[] = {
+        "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with", "be", "by",
+        "on", "not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have", "an", "had",
+        "they", "you", "were", "their", "one", "all", "we", "can", "her", "has", "there", "been", "if",
+        "more", "when", "will", "would", "who", "so", "no", "compression", "window", "match", "stream",
+        "buffer", "dictionary", "sequence", "literal", "position", "length", "between", "through"
+    };
+    const size_t wordCount = sizeof(words) / sizeof(words[0]);
+    std::mt19937 rng(1);
+    std::vector<uint8_t> text;
+    text.reserve(kCorpusSize + 32);
+    size_t sentence = 0;
+    size_t line = 0;
+    while (text.size() < kCorpusSize) {
+        // Squaring a uniform variate favours the common words
+        double u = std::generate_canonical<double, 32>(rng);
+        const char* word = words[static_cast<size_t>(u * u * wordCount)];
+        size_t length = std::strlen(word);
+        if (sentence == 0) {
+            text.push_back(static_cast<uint8_t>(word[0] - 'a' + 'A'));
+            text.insert(text.end(), word + 1, word + length);
+        } else {
+            text.insert(text.end(), word, word + length);
+        }
+        line += length + 1;
+        if (++sentence > 6 + rng() % 12) {
+            text.push_back('.');
+            sentence = 0;
+        }
+        if (line > 72) {
+            text.push_back('\n');
+            line = 0;
+        } else {
+            text.push_back(' ');
+        }
+    }
+    text.resize(kCorpusSize);
+    return text;
+}
+
+// Fixed-size records with counters, small enums and noisy measurements, as
+// found in telemetry dumps and executables' data sections
+std::vector<uint8_t> MakeBinary() {
+    std::mt19937 rng(2);
+    std::vector<uint8_t> data;
+    data.reserve(kCorpusSize + 32);
+    uint32_t id = 1000;
+    while (data.size() < kCorpusSize) {
+        uint8_t record[24] = {};
+        id += 1 + rng() % 3;
+        std::memcpy(record, &id, sizeof(id));
+        record[4] = static_cast<uint8_t>(rng() % 4);
+        record[5] = 0x7f;
+        uint32_t value = 500000 + rng() % 4096;
+        std::memcpy(record + 8, &value, sizeof(value));
+        float sample = static_cast<float>(rng() % 1000) / 10.0f;
+        std::memcpy(record + 16, &sample, sizeof(sample));
+        data.insert(data.end(), record, record + sizeof(record));
+    }
+    data.resize(kCorpusSize);
+    return data;
+}
+
+std::vector<uint8_t> MakeRandom() {
+    std::mt19937 rng(3);
+    std::vector<uint8_t> data(kCorpusSize);
+    for (uint8_t& b : data) {
+        b = static_cast<uint8_t>(rng());
+    }
+    return data;
+}
+
+const std::vector<uint8_t>& GetCorpus(int64_t corpus) {
+    static const std::vector<uint8_t> corpora[] = {
+        MakeText(), MakeBinary(), std::vector<uint8_t>(kCorpusSize, 0), MakeRandom()
+    };
+    return corpora[corpus];
+}
+
+// Settings the throughput benchmarks sweep over
+struct NamedSettings {
+    const char* name;
+    LzssSettings settings;
+};
+
+std::vector<NamedSettings> MakeSettings() {
+    std::vector<NamedSettings> list;
+    for (int32_t level : { 1, 3, 6, 7, 8 }) {
+        LzssSettings settings;
+        settings.compressionLevel = level;
+        static const char* const names[] = { "", "level1", "", "level3", "", "", "level6", "level7", "level8" };
+        list.push_back({ names[level], settings });
+    }
+    LzssSettings wide;
+    wide.frameSize = 0x10000;
+    wide.maxMatchLength = 0x102;
+    wide.frameInitPos = wide.frameSize - wide.maxMatchLength;
+    wide.compressionLevel = 4;
+    list.push_back({ "wide64k", wide });
+    return list;
+}
+
+const std::vector<NamedSettings>& GetSettings() {
+    static const std::vector<NamedSettings> list = MakeSettings();
+    return list;
+}
+
+void SetLabel(benchmark::State& state) {
+    state.SetLabel(std::string(kCorpusNames[state.range(0)]) + "/" + GetSettings()[state.range(1)].name);
+}
+
+void ReportRatio(benchmark::State& state, size_t inputSize, size_t outputSize) {
+    state.counters["ratio"] = inputSize != 0 ? static_cast<double>(outputSize) / inputSize : 0.0;
+}
+
+void CorpusBySettings(benchmark::internal::Benchmark* b) {
+    b->ArgNames({ "corpus", "settings" });
+    for (int64_t corpus = 0; corpus < CorpusCount; corpus++) {
+        for (size_t settings = 0; settings < GetSettings().size(); settings++) {
+            b->Args({ corpus, static_cast<int64_t>(settings) });
+        }
+    }
+    b->Unit(benchmark::kMillisecond);
+}
+
+void CorpusOnly(benchmark::internal::Benchmark* b) {
+    b->ArgNames({ "corpus" });
+    for (int64_t corpus = 0; corpus < CorpusCount; corpus++) {
+        b->Args({ corpus });
+    }
+    b->Unit(benchmark::kMillisecond);
+}
+
+// Throughput of the memory API across corpora and settings
+
+void BM_Compress(benchmark::State& state) {
+    const std::vector<uint8_t>& input = GetCorpus(state.range(0));
+    const LzssSettings& settings = GetSettings()[state.range(1)].settings;
+    std::vector<uint8_t> output;
+    for (auto _ : state) {
+        CompressData(input.data(), input.size(), output, settings);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * input.size());
+    ReportRatio(state, input.size(), output.size());
+    SetLabel(state);
+}
+BENCHMARK(BM_Compress)->Apply(CorpusBySettings);
+
+void BM_Decompress(benchmark::State& state) {
+    const std::vector<uint8_t>& input = GetCorpus(state.range(0));
+    const LzssSettings& settings = GetSettings()[state.range(1)].settings;
+    std::vector<uint8_t> packed;
+    CompressData(input.data(), input.size(), packed, settings);
+    std::vector<uint8_t> output;
+    for (auto _ : state) {
+        DecompressData(packed.data(), packed.size(), output, settings);
+        benchmark::DoNotOptimize(output.data());
+    }
+    if (output != input) {
+        state.SkipWithError("Round trip mismatch");
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * input.size());
+    ReportRatio(state, input.size(), packed.size());
+    SetLabel(state);
+}
+BENCHMARK(BM_Decompress)->Apply(CorpusBySettings);
+
+// Default settings through each entry point: the legacy vector helpers, the
+// caller-buffer overloads and the stream API
+
+void BM_CompressDataVector(benchmark::State& state) {
+    const std::vector<uint8_t>& input = GetCorpus(state.range(0));
+    for (auto _ : state) {
+        std::vector<uint8_t> output = CompressData(input);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * input.size());
+}
+BENCHMARK(BM_CompressDataVector)->Apply(CorpusOnly);
+
+void BM_CompressDataBuffer(benchmark::State& state) {
+    const std::vector<uint8_t>& input = GetCorpus(state.range(0));
+    std::vector<uint8_t> output(CompressBound(input.size()));
+    for (auto _ : state) {
+        size_t size = CompressData(input.data(), input.size(), output.data(), output.size());
+        benchmark::DoNotOptimize(size);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * input.size());
+}
+BENCHMARK(BM_CompressDataBuffer)->Apply(CorpusOnly);
+
+void BM_CompressStream(benchmark::State& state) {
+    const std::vector<uint8_t>& input = GetCorpus(state.range(0));
+    const std::string text(input.begin(), input.end());
+    for (auto _ : state) {
+        std::istringstream in(text);
+        std::ostringstream out;
+        LzssCompression lzss(in, out, true);
+        lzss.Compress();
+        benchmark::DoNotOptimize(out.tellp());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * input.size());
+}
+BENCHMARK(BM_CompressStream)->Apply(CorpusOnly);
+
+void BM_DecompressDataVector(benchmark::State& state) {
+    const std::vector<uint8_t>& input = GetCorpus(state.range(0));
+    const std::vector<uint8_t> packed = CompressData(input);
+    for (auto _ : state) {
+        std::vector<uint8_t> output = DecompressData(packed);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * input.size());
+}
+BENCHMARK(BM_DecompressDataVector)->Apply(CorpusOnly);
+
+void BM_DecompressDataBuffer(benchmark::State& state) {
+    const std::vector<uint8_t>& input = GetCorpus(state.range(0));
+    const std::vector<uint8_t> packed = CompressData(input);
+    std::vector<uint8_t> output(input.size());
+    for (auto _ : state) {
+        size_t size = DecompressData(packed.data(), packed.size(), output.data(), output.size());
+        benchmark::DoNotOptimize(size);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * input.size());
+}
+BENCHMARK(BM_DecompressDataBuffer)->Apply(CorpusOnly);
+
+void BM_DecompressStream(benchmark::State& state) {
+    const std::vector<uint8_t>& input = GetCorpus(state.range(0));
+    const std::vector<uint8_t> packed = CompressData(input);
+    const std::string text(packed.begin(), packed.end());
+    for (auto _ : state) {
+        std::istringstream in(text);
+        std::ostringstream out;
+        LzssCompression lzss(in, out, false);
+        lzss.Decompress();
+        benchmark::DoNotOptimize(out.tellp());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * input.size());
+}
+BENCHMARK(BM_DecompressStream)->Apply(CorpusOnly);
+
+// The streambuf adapters, written in log-line sized pieces and read back in
+// page-sized ones
+
+void BM_CompressStreambuf(benchmark::State& state) {
+    const std::vector<uint8_t>& input = GetCorpus(state.range(0));
+    const char* data = reinterpret_cast<const char*>(input.data());
+    for (auto _ : state) {
+        std::ostringstream out;
+        {
+            LzssOStreambuf packed(out);
+            std::ostream writer(&packed);
+            for (size_t pos = 0; pos < input.size(); pos += 100) {
+                writer.write(data + pos, std::min<size_t>(100, input.size() - pos));
+            }
+        }
+        benchmark::DoNotOptimize(out.tellp());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * input.size());
+}
+BENCHMARK(BM_CompressStreambuf)->Apply(CorpusOnly);
+
+void BM_DecompressStreambuf(benchmark::State& state) {
+    const std::vector<uint8_t>& input = GetCorpus(state.range(0));
+    const std::vector<uint8_t> packed = CompressData(input);
+    const std::string text(packed.begin(), packed.end());
+    char page[4096];
+    for (auto _ : state) {
+        std::istringstream in(text);
+        LzssIStreambuf unpacked(in);
+        std::istream reader(&unpacked);
+        size_t total = 0;
+        while (reader.read(page, sizeof(page)) || reader.gcount() > 0) {
+            total += static_cast<size_t>(reader.gcount());
+        }
+        if (total != input.size()) {
+            state.SkipWithError("Round trip mismatch");
+        }
+        benchmark::DoNotOptimize(page);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * input.size());
+}
+BENCHMARK(BM_DecompressStreambuf)->Apply(CorpusOnly);
+
+// One stream compressed by the pipeline in 128 KiB blocks, so the corpus
+// spreads over eight of them; compare with BM_CompressDataVector
+
+void CorpusByThreads(benchmark::internal::Benchmark* b) {
+    b->ArgNames({ "corpus", "threads" });
+    for (int64_t corpus = 0; corpus < CorpusCount; corpus++) {
+        for (int64_t threads : { 1, 2, 4, 8 }) {
+            b->Args({ corpus, threads });
+        }
+    }
+    b->UseRealTime();
+    b->Unit(benchmark::kMillisecond);
+}
+
+void BM_CompressPipelined(benchmark::State& state) {
+    const std::vector<uint8_t>& input = GetCorpus(state.range(0));
+    LzssPipelineSettings settings;
+    settings.blockSize = 128 << 10;
+    settings.threadCount = static_cast<size_t>(state.range(1));
+    std::vector<uint8_t> output;
+    for (auto _ : state) {
+        CompressPipelined(input.data(), input.size(), output, settings);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * input.size());
+    ReportRatio(state, input.size(), output.size());
+}
+BENCHMARK(BM_CompressPipelined)->Apply(CorpusByThreads);
+
+// Many small records: one CompressData() call per record against one batch
+
+std::vector<LzssSpan> MakeRecords(size_t recordSize) {
+    const std::vector<uint8_t>& text = GetCorpus(Text);
+    std::vector<LzssSpan> records;
+    for (size_t pos = 0; pos + recordSize <= text.size(); pos += recordSize) {
+        records.push_back({ text.data() + pos, recordSize });
+    }
+    return records;
+}
+
+void RecordSizes(benchmark::internal::Benchmark* b) {
+    b->ArgNames({ "record" });
+    for (int64_t size : { 64, 512, 4096 }) {
+        b->Args({ size });
+    }
+    b->Unit(benchmark::kMillisecond);
+}
+
+void BM_CompressRecords(benchmark::State& state) {
+    const std::vector<LzssSpan> records = MakeRecords(state.range(0));
+    std::vector<uint8_t> output;
+    for (auto _ : state) {
+        for (const LzssSpan& record : records) {
+            output.clear();
+            CompressData(record.data, record.size, output);
+            benchmark::DoNotOptimize(output.data());
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * records.size());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * records.size() * state.range(0));
+}
+BENCHMARK(BM_CompressRecords)->Apply(RecordSizes);
+
+void BM_CompressBatch(benchmark::State& state) {
+    const std::vector<LzssSpan> records = MakeRecords(state.range(0));
+    std::vector<uint8_t> output;
+    std::vector<size_t> offsets;
+    for (auto _ : state) {
+        CompressBatch(records.data(), records.size(), output, offsets);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * records.size());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * records.size() * state.range(0));
+}
+BENCHMARK(BM_CompressBatch)->Apply(RecordSizes);
+
+void BM_DecompressBatch(benchmark::State& state) {
+    const std::vector<LzssSpan> records = MakeRecords(state.range(0));
+    std::vector<uint8_t> packed;
+    std::vector<size_t> packedOffsets;
+    CompressBatch(records.data(), records.size(), packed, packedOffsets);
+    std::vector<uint8_t> output;
+    std::vector<size_t> offsets;
+    for (auto _ : state) {
+        DecompressBatch(packed, packedOffsets, output, offsets);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * records.size());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * records.size() * state.range(0));
+}
+BENCHMARK(BM_DecompressBatch)->Apply(RecordSizes);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,67 @@
+#include "LzssBatch.hpp"
+#include "LzssTestData.hpp"
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace Compression;
+using namespace Compression::test;
+
+namespace {
+
+std::vector<LzssSpan> MakeSpans(const std::vector<std::vector<uint8_t>>& records) {
+    std::vector<LzssSpan> spans;
+    for (const std::vector<uint8_t>& record : records) {
+        spans.push_back({ record.data(), record.size() });
+    }
+    return spans;
+}
+
+TEST(LzssBatch, RoundTripsRecordByRecord) {
+    std::vector<std::vector<uint8_t>> records;
+    for (uint32_t i = 0; i < 200; i++) {
+        records.push_back(i % 7 == 0 ? MakeRandom(i * 13, i) : MakeText(i * 37 % 3000, i));
+    }
+    const std::vector<LzssSpan> spans = MakeSpans(records);
+    for (size_t threads : { size_t(1), size_t(4) }) {
+        LzssBatchSettings settings;
+        settings.threadCount = threads;
+        std::vector<uint8_t> packed;
+        std::vector<size_t> packedOffsets;
+        CompressBatch(spans.data(), spans.size(), packed, packedOffsets, settings);
+        ASSERT_EQ(packedOffsets.size(), records.size() + 1);
+        for (size_t i = 0; i < records.size(); i++) {
+            EXPECT_EQ(std::vector<uint8_t>(packed.begin() + packedOffsets[i], packed.begin() + packedOffsets[i + 1]),
+                      CompressData(records[i]));
+        }
+
+        std::vector<uint8_t> unpacked;
+        std::vector<size_t> offsets;
+        DecompressBatch(packed, packedOffsets, unpacked, offsets, settings);
+        ASSERT_EQ(offsets.size(), records.size() + 1);
+        for (size_t i = 0; i < records.size(); i++) {
+            EXPECT_EQ(std::vector<uint8_t>(unpacked.begin() + offsets[i], unpacked.begin() + offsets[i + 1]),
+                      records[i]);
+        }
+    }
+}
+
+TEST(LzssBatch, MalformedRecordsStayInBounds) {
+    std::vector<std::vector<uint8_t>> records;
+    for (uint32_t i = 0; i < 50; i++) {
+        records.push_back(MakeRandom(i * 41, i));
+    }
+    const std::vector<LzssSpan> spans = MakeSpans(records);
+    LzssBatchSettings settings;
+    settings.threadCount = 4;
+    settings.codec = MakeShape(0x8000, 100, 3);
+    std::vector<uint8_t> output;
+    std::vector<size_t> offsets;
+    DecompressBatch(spans.data(), spans.size(), output, offsets, settings);
+    EXPECT_EQ(offsets.size(), records.size() + 1);
+
+    const std::vector<uint8_t> input(100);
+    EXPECT_THROW(DecompressBatch(input, { 0, 50, 200 }, output, offsets), std::out_of_range);
+    EXPECT_THROW(DecompressBatch(input, { 60, 50 }, output, offsets), std::out_of_range);
+}
+
+} // namespace
@@ -0,0 +1,316 @@
+#include "Lzss.hpp"
+#include "LzssChecksum.hpp"
+#include "LzssTestData.hpp"
+#include <gtest/gtest.h>
+#include <sstream>
+
+using namespace Compression;
+using namespace Compression::test;
+
+namespace {
+
+std::vector<uint8_t> WithLevel(const std::vector<uint8_t>& input, LzssSettings settings, int32_t level) {
+    settings.compressionLevel = level;
+    std::vector<uint8_t> packed;
+    CompressData(input.data(), input.size(), packed, settings);
+    return packed;
+}
+
+TEST(LzssCodec, RoundTripsEveryLevelAndShape) {
+    const std::vector<std::vector<uint8_t>> corpus = MakeCorpus();
+    for (const LzssSettings& shape : MakeShapes()) {
+        for (int32_t level = 0; level <= 8; level++) {
+            SCOPED_TRACE(ShapeName(shape) + " level " + std::to_string(level));
+            for (const std::vector<uint8_t>& input : corpus) {
+                std::vector<uint8_t> packed = WithLevel(input, shape, level);
+                ASSERT_LE(packed.size(), CompressBound(input.size()));
+                std::vector<uint8_t> unpacked;
+                DecompressData(packed.data(), packed.size(), unpacked, shape);
+                ASSERT_EQ(unpacked, input);
+            }
+        }
+    }
+}
+
+TEST(LzssCodec, DecodersAgree) {
+    const std::vector<uint8_t> input = MakeText(50000);
+    for (const LzssSettings& shape : MakeShapes()) {
+        SCOPED_TRACE(ShapeName(shape));
+        std::vector<uint8_t> packed;
+        CompressData(input.data(), input.size(), packed, shape);
+
+        std::vector<uint8_t> buffer(input.size());
+        ASSERT_EQ(DecompressData(packed.data(), packed.size(), buffer.data(), buffer.size(), shape), input.size());
+        EXPECT_EQ(buffer, input);
+
+        std::istringstream source(std::string(packed.begin(), packed.end()));
+        std::ostringstream sink;
+        LzssCompression lzss(source, sink, false, shape);
+        lzss.Decompress();
+        EXPECT_EQ(sink.str(), std::string(input.begin(), input.end()));
+
+        // Output capacities that split matches, and input handed over in pieces
+        LzssCompression stepper(false, shape);
+        std::vector<uint8_t> stepped;
+        size_t inPos = 0;
+        uint8_t chunk[7];
+        while (true) {
+            size_t used = 0;
+            size_t size = std::min<size_t>(packed.size() - inPos, 5);
+            size_t written = stepper.DecompressStep(packed.data() + inPos, size, used, chunk, sizeof(chunk));
+            stepped.insert(stepped.end(), chunk, chunk + written);
+            inPos += used;
+            if (written == 0 && used == 0) {
+                break;
+            }
+        }
+        EXPECT_EQ(stepped, input);
+    }
+}
+
+// Runs input through every decoder with settings; malformed input may decode
+// to anything, but must not touch memory outside the output
+std::vector<uint8_t> DecodeAllWays(const std::vector<uint8_t>& input, const LzssSettings& settings) {
+    std::vector<uint8_t> decoded;
+    DecompressData(input.data(), input.size(), decoded, settings);
+
+    for (size_t capacity : { size_t(0), size_t(1), size_t(100), decoded.size(), decoded.size() + 1000 }) {
+        std::vector<uint8_t> buffer(capacity);
+        size_t written = DecompressData(input.data(), input.size(), buffer.data(), buffer.size(), settings);
+        EXPECT_LE(written, capacity);
+    }
+
+    std::istringstream source(std::string(input.begin(), input.end()));
+    std::ostringstream sink;
+    LzssCompression stream(source, sink, false, settings);
+    stream.Decompress();
+    EXPECT_EQ(sink.str(), std::string(decoded.begin(), decoded.end()));
+
+    LzssCompression stepper(false, settings);
+    std::vector<uint8_t> chunk(33);
+    std::vector<uint8_t> stepped;
+    size_t inPos = 0;
+    while (true) {
+        size_t used = 0;
+        size_t written = stepper.DecompressStep(input.data() + inPos, input.size() - inPos, used,
+                                                chunk.data(), chunk.size());
+        stepped.insert(stepped.end(), chunk.begin(), chunk.begin() + written);
+        inPos += used;
+        if (written == 0 && used == 0) {
+            break;
+        }
+    }
+    EXPECT_EQ(stepped, decoded);
+    return decoded;
+}
+
+TEST(LzssCodec, MatchesLongerThanTheShapeStayInBounds) {
+    // Every token asks for the longest length the classic format can encode,
+    // 18 bytes, from a shape whose matches stop at 10
+    const LzssSettings shape = MakeShape(0x1000, 10, 2);
+    std::vector<uint8_t> input;
+    for (int group = 0; group < 64; group++) {
+        input.push_back(0x00);
+        for (int token = 0; token < 8; token++) {
+            input.push_back(0x00);
+            input.push_back(0x0f);
+        }
+    }
+    EXPECT_EQ(DecodeAllWays(input, shape).size(), 64u * 8 * 18);
+
+    // Random tokens against shapes with short matches in both formats
+    for (const LzssSettings& settings : { shape, MakeShape(0x8000, 100, 3), MakeShape(0x10000, 40, 2) }) {
+        SCOPED_TRACE(ShapeName(settings));
+        for (uint32_t seed = 1; seed <= 20; seed++) {
+            DecodeAllWays(MakeRandom(4000, seed), settings);
+        }
+    }
+}
+
+TEST(LzssCodec, TruncatedStreamsDecodeToAPrefix) {
+    const std::vector<uint8_t> input = MakeText(20000);
+    for (const LzssSettings& shape : MakeShapes()) {
+        SCOPED_TRACE(ShapeName(shape));
+        std::vector<uint8_t> packed;
+        CompressData(input.data(), input.size(), packed, shape);
+        for (size_t cut : { size_t(0), size_t(1), size_t(2), size_t(3), size_t(18), size_t(1001),
+                            packed.size() / 2, packed.size() - 2, packed.size() - 1 }) {
+            const std::vector<uint8_t> prefix(packed.begin(), packed.begin() + cut);
+            const std::vector<uint8_t> decoded = DecodeAllWays(prefix, shape);
+            ASSERT_LE(decoded.size(), input.size());
+            EXPECT_TRUE(std::equal(decoded.begin(), decoded.end(), input.begin())) << "cut at " << cut;
+        }
+    }
+}
+
+// Sizes and CRC-32C of the output of the original single-file codec for
+// MakeCorpus(), which the default settings have to reproduce exactly
+TEST(LzssCodec, DefaultOutputMatchesBaseline) {
+    struct Expected {
+        size_t size;
+        uint32_t crc;
+    };
+    const Expected expected[] = {
+        { 0, 0x00000000 },
+        { 2, 0x716EFFC4 },
+        { 20, 0xA5E05FC1 },
+        { 51857, 0x34403413 },
+        { 22498, 0xEF25C9E3 },
+        { 11831, 0x23E821EC },
+    };
+    const std::vector<std::vector<uint8_t>> corpus = MakeCorpus();
+    ASSERT_EQ(corpus.size(), sizeof(expected) / sizeof(expected[0]));
+    for (int32_t level : { 0, 6 }) {
+        for (size_t i = 0; i < corpus.size(); i++) {
+            SCOPED_TRACE("level " + std::to_string(level) + " input " + std::to_string(i));
+            std::vector<uint8_t> packed = WithLevel(corpus[i], LzssSettings(), level);
+            EXPECT_EQ(packed.size(), expected[i].size);
+            EXPECT_EQ(Crc32c(packed.data(), packed.size()), expected[i].crc);
+        }
+    }
+
+    const std::vector<uint8_t> small = {
+        0xff, 0x74, 0x68, 0x61, 0x74, 0x20, 0x61, 0x73, 0x20, 0xff, 0x61, 0x0a, 0x74, 0x6f,
+        0x20, 0x61, 0x20, 0x69, 0x7f, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x69, 0x74, 0x02, 0x00,
+        0x4f, 0x0a, 0x61, 0x6e, 0x64, 0xf5, 0xf0, 0xfd, 0xf0, 0x77, 0xf3, 0xf0,
+    };
+    EXPECT_EQ(CompressData(MakeText(40)), small);
+}
+
+TEST(LzssCodec, FixedShapeMatchesRuntimeShape) {
+    const std::vector<uint8_t> input = MakeText(100000);
+    std::vector<uint8_t> expected;
+    CompressData(input.data(), input.size(), expected);
+    LzssCodec<> codec(true);
+    std::vector<uint8_t> packed;
+    codec.Compress(input.data(), input.size(), packed);
+    EXPECT_EQ(packed, expected);
+
+    const LzssSettings wide = LzssCodec<0x10000, 258, 2>::Settings();
+    CompressData(input.data(), input.size(), expected, wide);
+    LzssCodec<0x10000, 258, 2> wideCodec(true);
+    packed.clear();
+    wideCodec.Compress(input.data(), input.size(), packed);
+    EXPECT_EQ(packed, expected);
+}
+
+TEST(LzssCodec, FeedInPiecesMatchesOneShot) {
+    const std::vector<uint8_t> input = MakeText(60000);
+    for (const LzssSettings& shape : MakeShapes()) {
+        for (int32_t level : { 0, 1, 6, 8 }) {
+            SCOPED_TRACE(ShapeName(shape) + " level " + std::to_string(level));
+            const std::vector<uint8_t> expected = WithLevel(input, shape, level);
+            LzssSettings settings = shape;
+            settings.compressionLevel = level;
+            for (size_t piece : { size_t(1), size_t(17), size_t(4096), size_t(25000) }) {
+                LzssCompression lzss(true, settings);
+                std::vector<uint8_t> packed;
+                for (size_t fed = 0; fed < input.size(); fed += piece) {
+                    lzss.Feed(input.data() + fed, std::min(piece, input.size() - fed), packed);
+                }
+                lzss.Finish(packed);
+                EXPECT_EQ(packed, expected) << "pieces of " << piece;
+            }
+        }
+    }
+}
+
+TEST(LzssCodec, FeedAfterFinishStartsAnIndependentStream) {
+    const std::vector<uint8_t> first = MakeText(70000, 4);
+    const std::vector<uint8_t> second = MakeRuns(30000, 5);
+    const std::vector<uint8_t> third = MakeText(500, 6);
+    const std::vector<uint8_t> history = MakeText(5000, 7);
+    for (const LzssSettings& shape : MakeShapes()) {
+        for (int32_t level : { 0, 1, 8 }) {
+            for (bool primed : { false, true }) {
+                SCOPED_TRACE(ShapeName(shape) + " level " + std::to_string(level) +
+                             (primed ? " with dictionary" : ""));
+                LzssSettings settings = shape;
+                settings.compressionLevel = level;
+                LzssDictionary dictionary(history.data(), history.size(), settings);
+                if (primed) {
+                    settings.dictionary = &dictionary;
+                }
+
+                LzssCompression lzss(true, settings);
+                for (const std::vector<uint8_t>* input : { &first, &second, &third }) {
+                    std::vector<uint8_t> packed;
+                    lzss.Feed(input->data(), input->size() / 2, packed);
+                    lzss.Feed(input->data() + input->size() / 2, input->size() - input->size() / 2, packed);
+                    lzss.Finish(packed);
+
+                    std::vector<uint8_t> expected;
+                    CompressData(input->data(), input->size(), expected, settings);
+                    EXPECT_EQ(packed, expected);
+                    std::vector<uint8_t> unpacked;
+                    DecompressData(packed.data(), packed.size(), unpacked, settings);
+                    EXPECT_EQ(unpacked, *input);
+                }
+            }
+        }
+    }
+}
+
+TEST(LzssCodec, ReusedCodecMatchesFreshCodec) {
+    const std::vector<std::vector<uint8_t>> inputs = {
+        MakeText(90000, 8), MakeRandom(3000, 9), MakeText(10, 10), MakeRuns(20000, 11), {}, MakeText(5000, 12)
+    };
+    for (const LzssSettings& shape : MakeShapes()) {
+        for (int32_t level : { 0, 2, 8 }) {
+            SCOPED_TRACE(ShapeName(shape) + " level " + std::to_string(level));
+            LzssSettings settings = shape;
+            settings.compressionLevel = level;
+            LzssCompression compressor(true, settings);
+            LzssCompression decompressor(false, settings);
+            for (size_t i = 0; i < inputs.size(); i++) {
+                const std::vector<uint8_t>& input = inputs[i];
+                std::vector<uint8_t> expected;
+                CompressData(input.data(), input.size(), expected, settings);
+
+                // Back to back without Reset(), alternating the overloads;
+                // an unfinished stream is dropped by the next Compress()
+                std::vector<uint8_t> packed;
+                if (i % 2 == 0) {
+                    compressor.Compress(input.data(), input.size(), packed);
+                } else {
+                    packed.resize(CompressBound(input.size()));
+                    packed.resize(compressor.Compress(input.data(), input.size(), packed.data(), packed.size()));
+                }
+                EXPECT_EQ(packed, expected) << "input " << i;
+                std::vector<uint8_t> ignored;
+                compressor.Feed(input.data(), input.size() / 3, ignored);
+
+                decompressor.Reset();
+                std::vector<uint8_t> unpacked;
+                decompressor.Decompress(packed.data(), packed.size(), unpacked);
+                EXPECT_EQ(unpacked, input) << "input " << i;
+            }
+        }
+    }
+
+    // The stream overloads, with new streams attached by Reset()
+    LzssCompression lzss(true);
+    for (const std::vector<uint8_t>& input : inputs) {
+        std::istringstream source(std::string(input.begin(), input.end()));
+        std::ostringstream sink;
+        lzss.Reset(source, sink);
+        lzss.Compress();
+        const std::string packed = sink.str();
+        EXPECT_EQ(std::vector<uint8_t>(packed.begin(), packed.end()), CompressData(input));
+    }
+}
+
+TEST(LzssCodec, FlushedStreamDecodesSoFar) {
+    const std::vector<uint8_t> input = MakeText(30000);
+    LzssCompression lzss(true);
+    std::vector<uint8_t> packed;
+    lzss.Feed(input.data(), 12345, packed);
+    lzss.Flush(packed);
+    EXPECT_EQ(DecompressData(packed), std::vector<uint8_t>(input.begin(), input.begin() + 12345));
+
+    lzss.Feed(input.data() + 12345, input.size() - 12345, packed);
+    lzss.Finish(packed);
+    EXPECT_EQ(DecompressData(packed), input);
+}
+
+} // namespace
@@ -0,0 +1,128 @@
+#include "LzssFile.hpp"
+#include "LzssTestData.hpp"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+using namespace Compression;
+using namespace Compression::test;
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// A fresh directory per test, removed with everything in it
+class LzssFile : public ::testing::Test {
+protected:
+    void SetUp() override {
+        const ::testing::TestInfo* info = ::testing::UnitTest::GetInstance()->current_test_info();
+        dir_ = fs::temp_directory_path() / (std::string("lzss_") + info->name());
+        fs::remove_all(dir_);
+        fs::create_directories(dir_);
+    }
+
+    void TearDown() override {
+        fs::remove_all(dir_);
+    }
+
+    std::string Path(const std::string& name) const {
+        return (dir_ / name).string();
+    }
+
+    static void Write(const std::string& path, const std::vector<uint8_t>& data) {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+
+    static std::vector<uint8_t> Read(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    size_t FileCount() const {
+        return static_cast<size_t>(std::distance(fs::directory_iterator(dir_), fs::directory_iterator()));
+    }
+
+    fs::path dir_;
+};
+
+TEST_F(LzssFile, RoundTrips) {
+    LzssFrameSettings settings;
+    settings.blockSize = 30000;
+    settings.checksum = true;
+    for (size_t size : { size_t(0), size_t(1000), size_t(200000) }) {
+        const std::vector<uint8_t> input = MakeText(size);
+        Write(Path("input"), input);
+        CompressFile(Path("input"), Path("packed"), settings);
+        DecompressFile(Path("packed"), Path("output"), settings);
+        EXPECT_EQ(Read(Path("output")), input);
+        EXPECT_EQ(FileCount(), 3u);
+    }
+    // Raw streams, which record no size
+    const std::vector<uint8_t> input = MakeText(100000);
+    Write(Path("raw"), CompressData(input));
+    DecompressFile(Path("raw"), Path("output"));
+    EXPECT_EQ(Read(Path("output")), input);
+}
+
+TEST_F(LzssFile, RejectsOutputOverInput) {
+    const std::vector<uint8_t> input = MakeText(100000);
+    Write(Path("data"), input);
+    EXPECT_THROW(CompressFile(Path("data"), Path("data")), std::invalid_argument);
+    EXPECT_THROW(CompressFile(Path("data"), (dir_ / "." / "data").string()), std::invalid_argument);
+    EXPECT_EQ(Read(Path("data")), input);
+
+    CompressFile(Path("data"), Path("packed"));
+    const std::vector<uint8_t> packed = Read(Path("packed"));
+    EXPECT_THROW(DecompressFile(Path("packed"), Path("packed")), std::invalid_argument);
+    EXPECT_EQ(Read(Path("packed")), packed);
+}
+
+TEST_F(LzssFile, CorruptFrameLeavesNoOutput) {
+    // A frame header whose content size no blocks back
+    std::vector<uint8_t> frame = { 'L', 'Z', 'S', 'F', static_cast<uint8_t>(LzssTokenFormat::Classic), 0, 0, 0 };
+    for (int i = 0; i < 8; i++) {
+        frame.push_back(i == 5 ? 0x40 : 0);
+    }
+    Write(Path("forged"), frame);
+    EXPECT_THROW(DecompressFile(Path("forged"), Path("output")), std::runtime_error);
+    EXPECT_FALSE(fs::exists(Path("output")));
+
+    // A frame that fails while its blocks decode keeps an existing output
+    LzssFrameSettings settings;
+    settings.blockSize = 10000;
+    settings.checksum = true;
+    std::vector<uint8_t> input = MakeText(50000);
+    std::vector<uint8_t> packed;
+    CompressFramed(input.data(), input.size(), packed, settings);
+    packed[packed.size() / 2] ^= 0x55;
+    Write(Path("damaged"), packed);
+    Write(Path("output"), { 'o', 'l', 'd' });
+    EXPECT_THROW(DecompressFile(Path("damaged"), Path("output"), settings), std::runtime_error);
+    EXPECT_EQ(Read(Path("output")), std::vector<uint8_t>({ 'o', 'l', 'd' }));
+    EXPECT_EQ(FileCount(), 3u);
+}
+
+TEST_F(LzssFile, OutputKeepsPermissions) {
+    Write(Path("input"), MakeText(50000));
+
+    // A new output gets the permissions of any newly created file
+    Write(Path("plain"), {});
+    CompressFile(Path("input"), Path("packed"));
+    EXPECT_EQ(fs::status(Path("packed")).permissions(), fs::status(Path("plain")).permissions());
+
+    // A replaced output keeps its own
+    const fs::perms ownerOnly = fs::perms::owner_read | fs::perms::owner_write;
+    fs::permissions(Path("packed"), ownerOnly);
+    CompressFile(Path("input"), Path("packed"));
+    EXPECT_EQ(fs::status(Path("packed")).permissions(), ownerOnly);
+    DecompressFile(Path("packed"), Path("packed2"));
+    fs::permissions(Path("packed2"), ownerOnly);
+    DecompressFile(Path("packed"), Path("packed2"));
+    EXPECT_EQ(fs::status(Path("packed2")).permissions(), ownerOnly);
+    EXPECT_EQ(FileCount(), 4u);
+}
+
+} // namespace
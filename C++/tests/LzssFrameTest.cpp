@@ -0,0 +1,176 @@
+#include "LzssFrame.hpp"
+#include "LzssTestData.hpp"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace Compression;
+using namespace Compression::test;
+
+namespace {
+
+std::vector<LzssFrameSettings> MakeFrameSettings() {
+    std::vector<LzssFrameSettings> all;
+    for (int variant = 0; variant < 8; variant++) {
+        LzssFrameSettings settings;
+        settings.blockSize = 20000;
+        settings.threadCount = 3;
+        settings.seekable = (variant & 1) != 0;
+        settings.checksum = (variant & 2) != 0;
+        settings.storeIncompressible = (variant & 4) != 0;
+        all.push_back(settings);
+    }
+    all.back().codec = MakeShape(0x10000, 258, 2);
+    return all;
+}
+
+void PutLE(std::vector<uint8_t>& out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+// Frame header with the given flags and content size and no blocks
+std::vector<uint8_t> MakeHeader(uint8_t flags, uint64_t contentSize) {
+    std::vector<uint8_t> frame = { 'L', 'Z', 'S', 'F', static_cast<uint8_t>(LzssTokenFormat::Classic), flags, 0, 0 };
+    PutLE(frame, contentSize, 8);
+    return frame;
+}
+
+TEST(LzssFrame, RoundTrips) {
+    std::vector<uint8_t> input = MakeText(150000);
+    const std::vector<uint8_t> noise = MakeRandom(30000);
+    input.insert(input.begin() + 40000, noise.begin(), noise.end());
+    for (const LzssFrameSettings& settings : MakeFrameSettings()) {
+        SCOPED_TRACE(std::string(settings.seekable ? " seekable" : "") + (settings.checksum ? " checksum" : "") +
+                     (settings.storeIncompressible ? " store" : ""));
+        std::vector<uint8_t> packed;
+        CompressFramed(input.data(), input.size(), packed, settings);
+        ASSERT_LE(packed.size(), CompressFramedBound(input.size(), settings));
+        ASSERT_TRUE(IsLzssFrame(packed.data(), packed.size()));
+        uint64_t contentSize = 0;
+        ASSERT_TRUE(GetFramedContentSize(packed.data(), packed.size(), contentSize, settings));
+        EXPECT_EQ(contentSize, input.size());
+
+        std::vector<uint8_t> unpacked;
+        DecompressFramed(packed.data(), packed.size(), unpacked, settings);
+        EXPECT_EQ(unpacked, input);
+
+        std::vector<uint8_t> range;
+        DecompressRange(packed.data(), packed.size(), 19000, 45000, range, settings);
+        EXPECT_EQ(range, std::vector<uint8_t>(input.begin() + 19000, input.begin() + 64000));
+        EXPECT_THROW(DecompressRange(packed.data(), packed.size(), input.size() - 10, 11, range, settings),
+                     std::out_of_range);
+    }
+}
+
+TEST(LzssFrame, SmallInputIsAPlainStream) {
+    const std::vector<uint8_t> input = MakeText(1000);
+    std::vector<uint8_t> packed;
+    CompressFramed(input.data(), input.size(), packed);
+    EXPECT_EQ(packed, CompressData(input));
+    std::vector<uint8_t> unpacked;
+    DecompressFramed(packed.data(), packed.size(), unpacked);
+    EXPECT_EQ(unpacked, input);
+}
+
+TEST(LzssFrame, RawStreamRangesAreChecked) {
+    const std::vector<uint8_t> input = MakeText(1000);
+    const std::vector<uint8_t> packed = CompressData(input);
+    ASSERT_FALSE(IsLzssFrame(packed.data(), packed.size()));
+    std::vector<uint8_t> range;
+    DecompressRange(packed.data(), packed.size(), 100, 200, range);
+    EXPECT_EQ(range, std::vector<uint8_t>(input.begin() + 100, input.begin() + 300));
+
+    // Past the end, wrapping around and beyond what the input could decode to
+    EXPECT_THROW(DecompressRange(packed.data(), packed.size(), 990, 11, range), std::out_of_range);
+    EXPECT_THROW(DecompressRange(packed.data(), packed.size(), UINT64_MAX, 2, range), std::out_of_range);
+    EXPECT_THROW(DecompressRange(packed.data(), packed.size(), 2, SIZE_MAX, range), std::out_of_range);
+    EXPECT_THROW(DecompressRange(packed.data(), packed.size(), uint64_t(1) << 46, 1, range), std::out_of_range);
+}
+
+TEST(LzssFrame, ForgedSizesAreRejectedBeforeAllocating) {
+    std::vector<uint8_t> output;
+    // A content size far beyond memory with no blocks to back it
+    const std::vector<uint8_t> empty = MakeHeader(0, uint64_t(1) << 46);
+    EXPECT_THROW(DecompressFramed(empty.data(), empty.size(), output), std::runtime_error);
+    uint64_t contentSize = 0;
+    EXPECT_THROW(GetFramedContentSize(empty.data(), empty.size(), contentSize), std::runtime_error);
+
+    // Blocks whose raw sizes add up, but which their few packed bytes
+    // could never decode to
+    std::vector<uint8_t> frame = MakeHeader(0, uint64_t(0x7fffffff) * 64);
+    for (int block = 0; block < 64; block++) {
+        PutLE(frame, 0x7fffffff, 4);
+        PutLE(frame, 2, 4);
+        frame.push_back(0x00);
+        frame.push_back(0x0f);
+    }
+    EXPECT_THROW(DecompressFramed(frame.data(), frame.size(), output), std::runtime_error);
+    EXPECT_THROW(DecompressRange(frame.data(), frame.size(), 0, 1, output), std::runtime_error);
+}
+
+// Decoding damaged frames either throws one of the documented errors or
+// produces output; it never reads or writes out of bounds
+void DecodeDamaged(const std::vector<uint8_t>& frame, const LzssFrameSettings& settings) {
+    std::vector<uint8_t> output;
+    try {
+        DecompressFramed(frame.data(), frame.size(), output, settings);
+    } catch (const std::runtime_error&) {
+    }
+    std::vector<uint8_t> buffer(300000);
+    try {
+        DecompressFramed(frame.data(), frame.size(), buffer.data(), buffer.size(), settings);
+    } catch (const std::runtime_error&) {
+    } catch (const std::length_error&) {
+    }
+    try {
+        DecompressRange(frame.data(), frame.size(), 25000, 1000, output, settings);
+    } catch (const std::runtime_error&) {
+    } catch (const std::out_of_range&) {
+    }
+}
+
+TEST(LzssFrame, DamagedFramesStayInBounds) {
+    std::vector<uint8_t> input = MakeText(60000);
+    const std::vector<uint8_t> noise = MakeRandom(10000);
+    input.insert(input.end(), noise.begin(), noise.end());
+    std::mt19937 rng(7);
+    for (const LzssFrameSettings& settings : MakeFrameSettings()) {
+        std::vector<uint8_t> packed;
+        CompressFramed(input.data(), input.size(), packed, settings);
+        for (size_t cut = 0; cut < packed.size(); cut += 1 + cut / 4) {
+            DecodeDamaged(std::vector<uint8_t>(packed.begin(), packed.begin() + cut), settings);
+        }
+        for (int flip = 0; flip < 200; flip++) {
+            std::vector<uint8_t> damaged = packed;
+            // Mostly the headers and the seek table, where sizes live
+            size_t at = flip % 2 == 0 ? rng() % std::min<size_t>(64, damaged.size())
+                                      : damaged.size() - 1 - rng() % std::min<size_t>(64, damaged.size());
+            damaged[at] ^= static_cast<uint8_t>(1 + rng() % 255);
+            DecodeDamaged(damaged, settings);
+        }
+    }
+}
+
+TEST(LzssFrame, UnknownFlagsAreRejected) {
+    const std::vector<uint8_t> input = MakeText(50000);
+    LzssFrameSettings settings;
+    settings.blockSize = 10000;
+    std::vector<uint8_t> packed;
+    CompressFramed(input.data(), input.size(), packed, settings);
+    std::vector<uint8_t> output;
+    DecompressFramed(packed.data(), packed.size(), output, settings);
+    EXPECT_EQ(output, input);
+
+    for (int bit = 2; bit < 8; bit++) {
+        std::vector<uint8_t> flagged = packed;
+        flagged[5] |= static_cast<uint8_t>(1 << bit);
+        EXPECT_THROW(DecompressFramed(flagged.data(), flagged.size(), output, settings), std::runtime_error)
+            << "flag bit " << bit;
+        EXPECT_THROW(DecompressRange(flagged.data(), flagged.size(), 0, 10, output, settings), std::runtime_error)
+            << "flag bit " << bit;
+    }
+}
+
+} // namespace
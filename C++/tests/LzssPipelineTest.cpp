@@ -0,0 +1,57 @@
+#include "LzssPipeline.hpp"
+#include "LzssTestData.hpp"
+#include <gtest/gtest.h>
+#include <sstream>
+
+using namespace Compression;
+using namespace Compression::test;
+
+namespace {
+
+TEST(LzssPipeline, RoundTripsAsAPlainStream) {
+    std::vector<uint8_t> input = MakeText(400000);
+    const std::vector<uint8_t> noise = MakeRandom(50000);
+    input.insert(input.begin() + 100000, noise.begin(), noise.end());
+    for (const LzssSettings& shape : MakeShapes()) {
+        for (size_t threads : { size_t(1), size_t(2), size_t(4) }) {
+            SCOPED_TRACE(ShapeName(shape) + " threads " + std::to_string(threads));
+            LzssPipelineSettings settings;
+            settings.codec = shape;
+            settings.blockSize = 70000;
+            settings.threadCount = threads;
+            std::vector<uint8_t> packed;
+            CompressPipelined(input.data(), input.size(), packed, settings);
+
+            std::vector<uint8_t> expected;
+            CompressData(input.data(), input.size(), expected, shape);
+            if (threads == 1) {
+                EXPECT_EQ(packed, expected);
+            } else {
+                // Only the tokens at block ends differ from the sequential ones
+                EXPECT_LT(packed.size(), expected.size() + expected.size() / 100);
+            }
+            std::vector<uint8_t> unpacked;
+            DecompressData(packed.data(), packed.size(), unpacked, shape);
+            EXPECT_EQ(unpacked, input);
+
+            std::istringstream source(std::string(input.begin(), input.end()));
+            std::ostringstream sink;
+            CompressPipelined(source, sink, settings);
+            EXPECT_EQ(sink.str(), std::string(packed.begin(), packed.end()));
+        }
+    }
+}
+
+TEST(LzssPipeline, SmallAndEmptyInputs) {
+    LzssPipelineSettings settings;
+    settings.blockSize = 7;
+    settings.threadCount = 3;
+    for (size_t size : { size_t(0), size_t(1), size_t(7), size_t(8), size_t(100), size_t(5000) }) {
+        const std::vector<uint8_t> input = MakeText(size);
+        std::vector<uint8_t> packed;
+        CompressPipelined(input.data(), input.size(), packed, settings);
+        EXPECT_EQ(DecompressData(packed), input) << size << " bytes";
+    }
+}
+
+} // namespace
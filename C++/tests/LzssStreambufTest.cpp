@@ -0,0 +1,88 @@
+#include "LzssStreambuf.hpp"
+#include "LzssTestData.hpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+using namespace Compression;
+using namespace Compression::test;
+
+namespace {
+
+std::vector<uint8_t> Bytes(const std::string& text) {
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+TEST(LzssStreambuf, RoundTripsThroughIostreams) {
+    const std::vector<uint8_t> input = MakeText(300000);
+    for (const LzssSettings& shape : MakeShapes()) {
+        SCOPED_TRACE(ShapeName(shape));
+        std::ostringstream sink;
+        {
+            LzssOStreambuf packed(sink, shape);
+            std::ostream out(&packed);
+            // Small writes go through the buffer, large ones around it
+            out.write(reinterpret_cast<const char*>(input.data()), 1000);
+            for (size_t i = 1000; i < 2000; i++) {
+                out.put(static_cast<char>(input[i]));
+            }
+            out.write(reinterpret_cast<const char*>(input.data()) + 2000, input.size() - 2000);
+        }
+        std::vector<uint8_t> expected;
+        CompressData(input.data(), input.size(), expected, shape);
+        EXPECT_EQ(Bytes(sink.str()), expected);
+
+        std::istringstream source(sink.str());
+        LzssIStreambuf unpacked(source, shape);
+        std::istream in(&unpacked);
+        std::string decoded((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        EXPECT_EQ(Bytes(decoded), input);
+    }
+}
+
+TEST(LzssStreambuf, WritesAfterFinishStartANewStream) {
+    const std::vector<uint8_t> first = MakeText(100000, 4);
+    const std::vector<uint8_t> second = MakeText(50000, 5);
+    std::ostringstream sink;
+    size_t split = 0;
+    {
+        LzssOStreambuf packed(sink);
+        std::ostream out(&packed);
+        out.write(reinterpret_cast<const char*>(first.data()), first.size());
+        ASSERT_TRUE(packed.Finish());
+        split = sink.str().size();
+        out.write(reinterpret_cast<const char*>(second.data()), second.size());
+    }
+    const std::vector<uint8_t> packed = Bytes(sink.str());
+    EXPECT_EQ(std::vector<uint8_t>(packed.begin(), packed.begin() + split), CompressData(first));
+    EXPECT_EQ(std::vector<uint8_t>(packed.begin() + split, packed.end()), CompressData(second));
+    EXPECT_EQ(DecompressData(std::vector<uint8_t>(packed.begin() + split, packed.end())), second);
+}
+
+TEST(LzssStreambuf, MalformedInputStaysInBounds) {
+    const std::vector<uint8_t> input = MakeText(40000);
+    const std::vector<uint8_t> packed = CompressData(input);
+    for (const LzssSettings& shape : MakeShapes()) {
+        for (uint32_t seed = 1; seed <= 5; seed++) {
+            std::vector<uint8_t> noise = MakeRandom(20000, seed);
+            std::istringstream source(std::string(noise.begin(), noise.end()));
+            LzssIStreambuf unpacked(source, shape);
+            std::istream in(&unpacked);
+            std::string decoded((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            std::vector<uint8_t> expected;
+            DecompressData(noise.data(), noise.size(), expected, shape);
+            EXPECT_EQ(Bytes(decoded), expected) << ShapeName(shape) << " seed " << seed;
+        }
+    }
+
+    // A truncated stream ends early with a prefix of the data
+    std::istringstream source(std::string(packed.begin(), packed.begin() + packed.size() / 2 + 1));
+    LzssIStreambuf unpacked(source);
+    std::istream in(&unpacked);
+    std::string decoded((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ASSERT_LT(decoded.size(), input.size());
+    EXPECT_TRUE(std::equal(decoded.begin(), decoded.end(), input.begin()));
+}
+
+} // namespace
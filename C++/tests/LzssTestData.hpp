@@ -0,0 +1,102 @@
+#pragma once
+#ifndef LZSS_TEST_DATA_HPP
+#define LZSS_TEST_DATA_HPP
+
+#include "Lzss.hpp"
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace Compression {
+namespace test {
+
+// Deterministic inputs shared by the tests. The generators only use the
+// exactly specified std::mt19937, so the data, and the compressed bytes
+// pinned in the tests, are the same on every platform.
+
+// Words from a small vocabulary, some far more common than others
+inline std::vector<uint8_t> MakeText(size_t size, uint32_t seed = 1) {
+    static const char* const words[] = {
+        "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with",
+        "compression", "window", "match", "stream", "buffer", "dictionary", "literal", "position"
+    };
+    const size_t wordCount = sizeof(words) / sizeof(words[0]);
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> text;
+    while (text.size() < size) {
+        // The lower of two picks favours the words at the front
+        size_t first = rng() % wordCount;
+        size_t second = rng() % wordCount;
+        const char* word = words[std::min(first, second)];
+        text.insert(text.end(), word, word + std::strlen(word));
+        text.push_back(rng() % 11 == 0 ? '\n' : ' ');
+    }
+    text.resize(size);
+    return text;
+}
+
+inline std::vector<uint8_t> MakeRandom(size_t size, uint32_t seed = 2) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> data(size);
+    for (uint8_t& byte : data) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return data;
+}
+
+// Long runs of a few byte values, for matches of every length
+inline std::vector<uint8_t> MakeRuns(size_t size, uint32_t seed = 3) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> data;
+    while (data.size() < size) {
+        data.insert(data.end(), 1 + rng() % 300, static_cast<uint8_t>(rng() % 3));
+    }
+    data.resize(size);
+    return data;
+}
+
+// Every generator at a size spanning many windows, and the edge sizes
+inline std::vector<std::vector<uint8_t>> MakeCorpus() {
+    std::vector<std::vector<uint8_t>> corpus;
+    corpus.push_back({});
+    corpus.push_back({ 'a' });
+    corpus.push_back(MakeText(17));
+    corpus.push_back(MakeText(200000));
+    corpus.push_back(MakeRandom(20000));
+    corpus.push_back(MakeRuns(100000));
+    return corpus;
+}
+
+// A window shape with its classic layout, the window starting maxMatchLength
+// bytes before its end
+inline LzssSettings MakeShape(int32_t frameSize, int32_t maxMatchLength, int32_t minMatchLength) {
+    LzssSettings settings;
+    settings.frameSize = frameSize;
+    settings.maxMatchLength = maxMatchLength;
+    settings.minMatchLength = minMatchLength;
+    settings.frameInitPos = frameSize - maxMatchLength;
+    return settings;
+}
+
+// The default shape, other classic shapes and wide shapes
+inline std::vector<LzssSettings> MakeShapes() {
+    return {
+        LzssSettings(),
+        MakeShape(0x400, 10, 2),
+        MakeShape(0x1000, 17, 1),
+        MakeShape(0x8000, 100, 3),
+        MakeShape(0x10000, 258, 2),
+    };
+}
+
+inline std::string ShapeName(const LzssSettings& settings) {
+    return std::to_string(settings.frameSize) + "/" + std::to_string(settings.maxMatchLength) + "/" +
+           std::to_string(settings.minMatchLength);
+}
+
+} // namespace test
+} // namespace Compression
+
+#endif // LZSS_TEST_DATA_HPP
@@ -0,0 +1,108 @@
+/*
+ * Conformance adapter for lzss.c, Okumura's original coder and the reference
+ * stream of the harness. See run.py for the command line.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int lzss_decode(uint8_t *dst, uint8_t *src, uint32_t srclen);
+uint8_t *lzss_encode(uint8_t *dst, uint32_t dstlen, uint8_t *src, uint32_t srcLen);
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+	FILE *file = fopen(path, "rb");
+	uint8_t *data;
+	long length;
+
+	if (file == NULL || fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < 0) {
+		fprintf(stderr, "cannot read %s\n", path);
+		exit(2);
+	}
+	rewind(file);
+	data = (uint8_t *) malloc((size_t) length + 1);
+	if (data == NULL || fread(data, 1, (size_t) length, file) != (size_t) length) {
+		fprintf(stderr, "cannot read %s\n", path);
+		exit(2);
+	}
+	fclose(file);
+	*size = (size_t) length;
+	return data;
+}
+
+static void write_file(const char *path, const uint8_t *data, size_t size)
+{
+	FILE *file = fopen(path, "wb");
+
+	if (file == NULL || fwrite(data, 1, size, file) != size || fclose(file) != 0) {
+		fprintf(stderr, "cannot write %s\n", path);
+		exit(2);
+	}
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t *input, *output;
+	size_t input_size, capacity, output_size = 0;
+	int compress;
+	double min_seconds;
+	int64_t total = 0, best = -1;
+	long iterations = 0;
+
+	if (argc < 5 || (strcmp(argv[1], "compress") != 0 && strcmp(argv[1], "decompress") != 0)) {
+		fprintf(stderr, "usage: %s <compress|decompress> <input> <output> <min_seconds> [raw_size]\n", argv[0]);
+		return 2;
+	}
+	compress = strcmp(argv[1], "compress") == 0;
+	min_seconds = atof(argv[4]);
+	input = read_file(argv[2], &input_size);
+
+	/* Nine bytes per eight literals at worst; lzss_decode does not bound its
+	 * output, so the raw size is required to decompress */
+	if (compress) {
+		capacity = input_size + input_size / 8 + 2;
+	} else if (argc > 5) {
+		capacity = (size_t) strtoull(argv[5], NULL, 10) + 1;
+	} else {
+		fprintf(stderr, "decompress needs the raw size\n");
+		return 2;
+	}
+	output = (uint8_t *) malloc(capacity);
+
+	do {
+		int64_t start = now_ns(), elapsed;
+
+		if (compress) {
+			uint8_t *end = input_size == 0 ? output : lzss_encode(output, (uint32_t) capacity, input, (uint32_t) input_size);
+			if (end == NULL) {
+				fprintf(stderr, "lzss_encode failed\n");
+				return 1;
+			}
+			output_size = (size_t) (end - output);
+		} else {
+			output_size = (size_t) lzss_decode(output, input, (uint32_t) input_size);
+		}
+		elapsed = now_ns() - start;
+		total += elapsed;
+		if (best < 0 || elapsed < best) {
+			best = elapsed;
+		}
+		iterations++;
+	} while (total < (int64_t) (min_seconds * 1e9));
+
+	write_file(argv[3], output, output_size);
+	printf("%ld %lld\n", iterations, (long long) best);
+	free(output);
+	free(input);
+	return 0;
+}
@@ -0,0 +1,110 @@
+// Conformance adapter for the C++ library. Without options it runs
+// CompressData()/DecompressData() on whole buffers; with --stream it goes
+// through LzssOStreambuf/LzssIStreambuf, so the incremental encoder and the
+// resumable decoder are checked as well. See run.py for the command line.
+#include "Lzss.hpp"
+#include "LzssStreambuf.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+using namespace Compression;
+
+namespace {
+
+std::vector<uint8_t> ReadFile(const char* path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "cannot read " << path << "\n";
+        std::exit(2);
+    }
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void WriteFile(const char* path, const std::vector<uint8_t>& data) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!file.flush()) {
+        std::cerr << "cannot write " << path << "\n";
+        std::exit(2);
+    }
+}
+
+void CompressStream(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) {
+    std::ostringstream sink;
+    {
+        LzssOStreambuf packed(sink);
+        packed.sputn(reinterpret_cast<const char*>(input.data()), input.size());
+        packed.Finish();
+    }
+    const std::string& data = sink.str();
+    output.assign(data.begin(), data.end());
+}
+
+void DecompressStream(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) {
+    std::istringstream source(std::string(input.begin(), input.end()));
+    LzssIStreambuf unpacked(source);
+    output.resize(output.capacity());
+    size_t size = 0;
+    for (;;) {
+        if (size == output.size()) {
+            output.resize(std::max<size_t>(output.size() * 2, 0x10000));
+        }
+        std::streamsize part = unpacked.sgetn(reinterpret_cast<char*>(output.data()) + size, output.size() - size);
+        if (part <= 0) {
+            break;
+        }
+        size += static_cast<size_t>(part);
+    }
+    output.resize(size);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool stream = argc > 1 && std::strcmp(argv[1], "--stream") == 0;
+    if (stream) {
+        argc--;
+        argv++;
+    }
+    if (argc < 5 || (std::strcmp(argv[1], "compress") != 0 && std::strcmp(argv[1], "decompress") != 0)) {
+        std::cerr << "usage: " << argv[0] << " [--stream] <compress|decompress> <input> <output> <min_seconds> [raw_size]\n";
+        return 2;
+    }
+    const bool compress = std::strcmp(argv[1], "compress") == 0;
+    const double minSeconds = std::atof(argv[4]);
+    const std::vector<uint8_t> input = ReadFile(argv[2]);
+    std::vector<uint8_t> output;
+    if (!compress && argc > 5) {
+        output.reserve(std::strtoull(argv[5], nullptr, 10));
+    }
+
+    using Clock = std::chrono::steady_clock;
+    Clock::duration total = Clock::duration::zero();
+    Clock::duration best = Clock::duration::max();
+    long iterations = 0;
+    do {
+        const Clock::time_point start = Clock::now();
+        if (stream) {
+            compress ? CompressStream(input, output) : DecompressStream(input, output);
+        } else {
+            compress ? CompressData(input.data(), input.size(), output) : DecompressData(input.data(), input.size(), output);
+        }
+        const Clock::duration elapsed = Clock::now() - start;
+        total += elapsed;
+        best = std::min(best, elapsed);
+        iterations++;
+    } while (total < std::chrono::duration<double>(minSeconds));
+
+    WriteFile(argv[3], output);
+    std::printf("%ld %lld\n", iterations,
+                static_cast<long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(best).count()));
+    return 0;
+}
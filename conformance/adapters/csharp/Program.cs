@@ -0,0 +1,75 @@
+// Conformance adapter for LzssStream.cs. See run.py for the command line.
+using System;
+using System.Diagnostics;
+using System.IO;
+using System.IO.Compression;
+
+// LzssStream fills the window with spaces by default; the other
+// implementations, and Okumura's original, start from zeros
+internal sealed class ZeroFilledLzssStream : LzssStream
+{
+    public ZeroFilledLzssStream(Stream stream, CompressionMode mode) : base(stream, mode, true) { }
+
+    protected override byte CharFiller => 0;
+}
+
+internal static class Program
+{
+    private static int Main(string[] args)
+    {
+        if (args.Length < 4 || (args[0] != "compress" && args[0] != "decompress"))
+        {
+            Console.Error.WriteLine("usage: Conformance <compress|decompress> <input> <output> <min_seconds> <raw_size>");
+            return 2;
+        }
+        bool compress = args[0] == "compress";
+        var minTime = TimeSpan.FromSeconds(double.Parse(args[3], System.Globalization.CultureInfo.InvariantCulture));
+        byte[] input = File.ReadAllBytes(args[1]);
+        // Read() decodes up to the count asked for, so the raw size is needed
+        int rawSize = args.Length > 4 ? int.Parse(args[4]) : input.Length;
+
+        byte[] output = Array.Empty<byte>();
+        var total = TimeSpan.Zero;
+        var best = TimeSpan.MaxValue;
+        long iterations = 0;
+        do
+        {
+            var watch = Stopwatch.StartNew();
+            output = compress ? Compress(input) : Decompress(input, rawSize);
+            var elapsed = watch.Elapsed;
+            total += elapsed;
+            if (elapsed < best)
+            {
+                best = elapsed;
+            }
+            iterations++;
+        } while (total < minTime);
+
+        File.WriteAllBytes(args[2], output);
+        Console.WriteLine($"{iterations} {(long)(best.Ticks * (1e9 / TimeSpan.TicksPerSecond))}");
+        return 0;
+    }
+
+    private static byte[] Compress(byte[] input)
+    {
+        var sink = new MemoryStream();
+        if (input.Length > 0)
+        {
+            using var lzss = new ZeroFilledLzssStream(sink, CompressionMode.Compress);
+            lzss.Write(input, 0, input.Length);
+        }
+        return sink.ToArray();
+    }
+
+    private static byte[] Decompress(byte[] input, int rawSize)
+    {
+        var output = new byte[rawSize];
+        using var lzss = new ZeroFilledLzssStream(new MemoryStream(input), CompressionMode.Decompress);
+        int size = lzss.Read(output, 0, rawSize);
+        if (size != rawSize)
+        {
+            Array.Resize(ref output, size);
+        }
+        return output;
+    }
+}
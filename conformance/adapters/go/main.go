@@ -0,0 +1,56 @@
+// Conformance adapter for LzssCompression.go. run.py builds it in a module
+// of its own next to a copy of the package. See run.py for the command line.
+package main
+
+import (
+	"fmt"
+	"os"
+	"strconv"
+	"time"
+
+	"lzss_conformance/lzss"
+)
+
+func main() {
+	if len(os.Args) < 5 || (os.Args[1] != "compress" && os.Args[1] != "decompress") {
+		fmt.Fprintf(os.Stderr, "usage: %s <compress|decompress> <input> <output> <min_seconds> [raw_size]\n", os.Args[0])
+		os.Exit(2)
+	}
+	compress := os.Args[1] == "compress"
+	seconds, _ := strconv.ParseFloat(os.Args[4], 64)
+	minTime := time.Duration(seconds * float64(time.Second))
+	input, err := os.ReadFile(os.Args[2])
+	if err != nil {
+		fmt.Fprintln(os.Stderr, err)
+		os.Exit(2)
+	}
+
+	settings := lzss.DefaultSettings()
+	var output []byte
+	var total time.Duration
+	best := time.Duration(-1)
+	iterations := 0
+	for {
+		start := time.Now()
+		if compress {
+			output = lzss.Compress(input, settings)
+		} else {
+			output = lzss.Decompress(input, settings)
+		}
+		elapsed := time.Since(start)
+		total += elapsed
+		if best < 0 || elapsed < best {
+			best = elapsed
+		}
+		iterations++
+		if total >= minTime {
+			break
+		}
+	}
+
+	if err := os.WriteFile(os.Args[3], output, 0o644); err != nil {
+		fmt.Fprintln(os.Stderr, err)
+		os.Exit(2)
+	}
+	fmt.Printf("%d %d\n", iterations, best.Nanoseconds())
+}
@@ -0,0 +1,32 @@
+// Conformance adapter for LzssCompression.js. See run.py for the command line.
+'use strict';
+
+const fs = require('fs');
+const path = require('path');
+const lzss = require(path.join(__dirname, '..', '..', 'LzssCompression.js'));
+
+const [mode, inputPath, outputPath, seconds] = process.argv.slice(2);
+if (!outputPath || (mode !== 'compress' && mode !== 'decompress')) {
+  console.error('usage: js_adapter.js <compress|decompress> <input> <output> <min_seconds> [raw_size]');
+  process.exit(2);
+}
+
+const input = fs.readFileSync(inputPath);
+const minTime = BigInt(Math.round(parseFloat(seconds || '0') * 1e9));
+let output;
+let total = 0n;
+let best = -1n;
+let iterations = 0;
+do {
+  const start = process.hrtime.bigint();
+  output = lzss[mode](input);
+  const elapsed = process.hrtime.bigint() - start;
+  total += elapsed;
+  if (best < 0n || elapsed < best) {
+    best = elapsed;
+  }
+  iterations++;
+} while (total < minTime);
+
+fs.writeFileSync(outputPath, output);
+console.log(`${iterations} ${best}`);
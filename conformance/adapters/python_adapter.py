@@ -0,0 +1,40 @@
+"""Conformance adapter for LzssCompression.py. See run.py for the command line."""
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..'))
+import LzssCompression as lzss  # noqa: E402
+
+
+def main():
+    if len(sys.argv) < 5 or sys.argv[1] not in ('compress', 'decompress'):
+        print('usage: python_adapter.py <compress|decompress> <input> <output> <min_seconds> [raw_size]', file=sys.stderr)
+        return 2
+    mode, input_path, output_path = sys.argv[1:4]
+    min_time = int(float(sys.argv[4]) * 1e9)
+    with open(input_path, 'rb') as f:
+        data = f.read()
+
+    operation = lzss.compress if mode == 'compress' else lzss.decompress
+    total = 0
+    best = None
+    iterations = 0
+    while True:
+        start = time.perf_counter_ns()
+        output = operation(data)
+        elapsed = time.perf_counter_ns() - start
+        total += elapsed
+        best = elapsed if best is None else min(best, elapsed)
+        iterations += 1
+        if total >= min_time:
+            break
+
+    with open(output_path, 'wb') as f:
+        f.write(output or b'')
+    print(iterations, best)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
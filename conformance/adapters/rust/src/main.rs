@@ -0,0 +1,50 @@
+//! Conformance adapter for rust/src/lzss_stream.rs. See run.py for the
+//! command line.
+use std::env;
+use std::fs;
+use std::process;
+use std::time::{Duration, Instant};
+
+#[path = "../../../../rust/src/lzss_stream.rs"]
+mod lzss_stream;
+use crate::lzss_stream::Lzss;
+
+fn main() {
+    let args: Vec<String> = env::args().collect();
+    if args.len() < 5 || (args[1] != "compress" && args[1] != "decompress") {
+        eprintln!("usage: {} <compress|decompress> <input> <output> <min_seconds> [raw_size]", args[0]);
+        process::exit(2);
+    }
+    let compress = args[1] == "compress";
+    let min_time = Duration::from_secs_f64(args[4].parse().unwrap_or(0.0));
+    let input = fs::read(&args[2]).unwrap_or_else(|e| {
+        eprintln!("cannot read {}: {}", args[2], e);
+        process::exit(2);
+    });
+
+    let mut lzss = Lzss::new();
+    let mut total = Duration::ZERO;
+    let mut best = Duration::MAX;
+    let mut iterations = 0u64;
+    let output = loop {
+        let start = Instant::now();
+        let result = if compress { lzss.compress(&input) } else { lzss.decompress(&input) };
+        let elapsed = start.elapsed();
+        let output = result.unwrap_or_else(|e| {
+            eprintln!("{} failed: {}", args[1], e);
+            process::exit(1);
+        });
+        total += elapsed;
+        best = best.min(elapsed);
+        iterations += 1;
+        if total >= min_time {
+            break output;
+        }
+    };
+
+    fs::write(&args[3], &output).unwrap_or_else(|e| {
+        eprintln!("cannot write {}: {}", args[3], e);
+        process::exit(2);
+    });
+    println!("{} {}", iterations, best.as_nanos());
+}
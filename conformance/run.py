@@ -0,0 +1,436 @@
+#!/usr/bin/env python3
+"""Cross-language conformance and throughput harness.
+
+Builds a small adapter around every implementation in the repository, runs
+them all over a shared corpus and checks that
+
+  * each one compresses every file to exactly the bytes of the reference
+    implementation of its stream format, and
+  * each one decompresses the reference stream back to the original file,
+
+then reports compress and decompress throughput per implementation. The
+reference of the Okumura format (N=4096, F=18, threshold 2, window filled
+with zeros) is LzssCompression.go, a line-by-line port of Okumura's coder;
+lzss.c would be the natural choice, but its encoder fills the window with
+spaces and its decoder with zeros, so it does not even agree with itself on
+data that matches against the initial window. The C, C++, C#, Python and
+JavaScript implementations are held to the reference. rust/src/lzss_stream.rs
+writes a format of its own (N=2048, F=24, threshold 1, 11-bit positions and
+5-bit lengths), so it can only be checked against itself by round trip.
+
+    python3 conformance/run.py                    # everything that builds
+    python3 conformance/run.py --impl c,cpp,go    # a subset
+    python3 conformance/run.py --corpus DIR       # your own files
+    python3 conformance/run.py --size 4M --min-time 2
+
+Implementations whose toolchain is missing are skipped with a note. The
+exit status is 1 when any implementation disagrees with its reference or
+fails, so the script can guard changes to the C++ core in CI. Mismatches
+listed in KNOWN_FAILURES are reported as XFAIL and do not count, so only new
+ones turn the run red; --strict counts them as well.
+
+Every adapter takes the same command line,
+
+    <adapter> <compress|decompress> <input> <output> <min_seconds> <raw_size>
+
+repeats the operation in-process until min_seconds have passed (at least
+once), writes the result of the last run to output and prints the iteration
+count and the fastest run in nanoseconds. raw_size is the uncompressed size,
+which the C and C# decoders need up front. Startup and I/O are therefore
+left out of the figures. Throughput is uncompressed megabytes (10^6 bytes)
+per second of the fastest run, summed over the corpus files of at least
+64 KiB so the small edge cases do not skew it.
+"""
+
+import argparse
+import os
+import random
+import shutil
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(HERE)
+ADAPTERS = os.path.join(HERE, 'adapters')
+BUILD = os.path.join(HERE, '_build')
+
+OKUMURA = 'okumura'
+RUST_FORMAT = 'rust'
+
+# Files below this size are checked but left out of the throughput figures
+THROUGHPUT_MIN_SIZE = 64 * 1024
+
+# Sizes around the window and match length limits, where off-by-one errors
+# in the ring buffer and the match finder show up
+EDGE_SIZES = [0, 1, 2, 3, 17, 18, 19, 4077, 4078, 4079, 4095, 4096, 4097, 8192 + 18]
+
+
+class AdapterError(Exception):
+    pass
+
+
+def newer_than(target, sources):
+    """True when target exists and is at least as new as every source."""
+    if not os.path.exists(target):
+        return False
+    built = os.path.getmtime(target)
+    return all(os.path.getmtime(source) <= built for source in sources)
+
+
+def run_build(command, cwd=None, env=None):
+    result = subprocess.run(command, cwd=cwd, env=env, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            universal_newlines=True)
+    if result.returncode != 0:
+        raise AdapterError('build failed: %s\n%s' % (' '.join(command), result.stdout.strip()))
+
+
+def build_c():
+    target = os.path.join(BUILD, 'c_adapter')
+    sources = [os.path.join(ADAPTERS, 'c_adapter.c'), os.path.join(ROOT, 'lzss.c')]
+    if not newer_than(target, sources):
+        compiler = os.environ.get('CC') or shutil.which('cc') or shutil.which('gcc') or shutil.which('clang')
+        if compiler is None:
+            return None
+        run_build([compiler, '-O2', '-o', target] + sources)
+    return [target]
+
+
+def build_cpp():
+    target = os.path.join(BUILD, 'cpp_adapter')
+    library = os.path.join(ROOT, 'C++')
+    sources = [os.path.join(ADAPTERS, 'cpp_adapter.cpp')]
+    sources += sorted(os.path.join(library, name) for name in os.listdir(library) if name.endswith('.cpp'))
+    headers = [os.path.join(library, name) for name in os.listdir(library) if name.endswith('.hpp')]
+    if not newer_than(target, sources + headers):
+        compiler = os.environ.get('CXX') or shutil.which('c++') or shutil.which('g++') or shutil.which('clang++')
+        if compiler is None:
+            return None
+        run_build([compiler, '-O2', '-std=c++17', '-I', library, '-o', target] + sources + ['-pthread'])
+    return [target]
+
+
+def build_cpp_stream():
+    command = build_cpp()
+    return command + ['--stream'] if command else None
+
+
+def build_rust():
+    cargo = shutil.which('cargo')
+    if cargo is None:
+        return None
+    manifest = os.path.join(ADAPTERS, 'rust', 'Cargo.toml')
+    target_dir = os.path.join(BUILD, 'rust')
+    run_build([cargo, 'build', '--quiet', '--release', '--manifest-path', manifest, '--target-dir', target_dir])
+    return [os.path.join(target_dir, 'release', 'lzss_conformance')]
+
+
+def build_go():
+    go = shutil.which('go')
+    if go is None:
+        return None
+    # The package sits in the repository root without a module of its own,
+    # so the adapter is built in a scratch module holding a copy of it
+    module = os.path.join(BUILD, 'go')
+    os.makedirs(os.path.join(module, 'lzss'), exist_ok=True)
+    with open(os.path.join(module, 'go.mod'), 'w') as f:
+        f.write('module lzss_conformance\n\ngo 1.18\n')
+    shutil.copy(os.path.join(ADAPTERS, 'go', 'main.go'), os.path.join(module, 'main.go'))
+    shutil.copy(os.path.join(ROOT, 'LzssCompression.go'), os.path.join(module, 'lzss', 'LzssCompression.go'))
+    target = os.path.join(BUILD, 'go_adapter')
+    run_build([go, 'build', '-o', target, '.'], cwd=module)
+    return [target]
+
+
+def build_csharp():
+    dotnet = shutil.which('dotnet')
+    if dotnet is None:
+        return None
+    output = os.path.join(BUILD, 'csharp')
+    project = os.path.join(ADAPTERS, 'csharp', 'Conformance.csproj')
+    env = dict(os.environ, DOTNET_CLI_TELEMETRY_OPTOUT='1', DOTNET_NOLOGO='1')
+    run_build([dotnet, 'build', '--nologo', '-v', 'q', '-c', 'Release', '-o', output, project], env=env)
+    return [dotnet, os.path.join(output, 'Conformance.dll')]
+
+
+def build_python():
+    return [sys.executable, os.path.join(ADAPTERS, 'python_adapter.py')]
+
+
+def build_js():
+    node = shutil.which('node')
+    if node is None:
+        return None
+    return [node, os.path.join(ADAPTERS, 'js_adapter.js')]
+
+
+# In report order, which puts the reference of each format (the first of
+# its implementations) ahead of the others
+IMPLEMENTATIONS = [
+    ('go', OKUMURA, build_go, 'LzssCompression.go'),
+    ('c', OKUMURA, build_c, 'lzss.c'),
+    ('cpp', OKUMURA, build_cpp, 'C++ CompressData/DecompressData'),
+    ('cpp-stream', OKUMURA, build_cpp_stream, 'C++ LzssOStreambuf/LzssIStreambuf'),
+    ('csharp', OKUMURA, build_csharp, 'LzssStream.cs, window filled with zeros'),
+    ('js', OKUMURA, build_js, 'LzssCompression.js'),
+    ('python', OKUMURA, build_python, 'LzssCompression.py'),
+    ('rust', RUST_FORMAT, build_rust, 'rust/src/lzss_stream.rs, own format'),
+]
+
+# Checks known to fail, by implementation, with the bug behind them. A
+# 'compress' check compares the compressed output with the reference, a
+# 'decompress' check decodes the reference stream; adapters that crash are
+# never expected. A listed check that passes on every file is reported, so
+# the entry can be dropped once the bug is fixed.
+KNOWN_FAILURES = {
+    'c': ({'compress'}, 'the encoder fills the window with spaces, the decoder with zeros'),
+    'js': ({'compress', 'decompress'}, 'the flag mask is never cut to 8 bits and decompress writes into a '
+           'buffer twice the input size'),
+}
+
+# LzssCompression.java declares several public classes in one file and does
+# not compile as it stands, so it has no adapter
+UNSUPPORTED = [
+    ('java', 'LzssCompression.java does not compile as a single file'),
+]
+
+
+def make_text(size, rng):
+    words = ('the of and to in a is that for it as was with be by on not he this are or his from at which '
+             'but have an had they you were their one all we can her has there been if more when will would '
+             'who so no compression window match stream buffer dictionary sequence literal position length '
+             'between through').split()
+    out = bytearray()
+    sentence = 0
+    line = 0
+    while len(out) < size:
+        # Squaring a uniform variate favours the common words
+        word = words[int(rng.random() ** 2 * len(words))]
+        if sentence == 0:
+            word = word.capitalize()
+        out += word.encode()
+        sentence += 1
+        line += len(word) + 1
+        if sentence > 8 + rng.randrange(12):
+            out += b'.'
+            sentence = 0
+        if line > 72:
+            out += b'\n'
+            line = 0
+        else:
+            out += b' '
+    return bytes(out[:size])
+
+
+def make_binary(size, rng):
+    # Fixed-size records of small counters, flags and a few random fields, as
+    # in tables and object files
+    out = bytearray()
+    index = 0
+    while len(out) < size:
+        out += index.to_bytes(4, 'little')
+        out += (index * 7 % 1000).to_bytes(2, 'little')
+        out += bytes([rng.randrange(4), 0, 0, 0xff])
+        out += rng.getrandbits(32).to_bytes(4, 'little') if rng.random() < 0.3 else bytes(4)
+        out += b'rec\0'
+        index += 1
+    return bytes(out[:size])
+
+
+def make_corpus(directory, size):
+    """Writes the generated corpus; the same size always gives the same files."""
+    os.makedirs(directory, exist_ok=True)
+    rng = random.Random(20240229)
+    files = {
+        'text': make_text(size, rng),
+        'binary': make_binary(size, rng),
+        'zeros': bytes(size),
+        'random': rng.getrandbits(8 * size).to_bytes(size, 'little') if size else b'',
+    }
+    edge = make_text(max(EDGE_SIZES), random.Random(1989))
+    for edge_size in EDGE_SIZES:
+        files['edge-%d' % edge_size] = edge[:edge_size]
+    paths = []
+    for name, data in files.items():
+        path = os.path.join(directory, name)
+        if not os.path.exists(path) or os.path.getsize(path) != len(data):
+            with open(path, 'wb') as f:
+                f.write(data)
+        paths.append(path)
+    return paths
+
+
+def parse_size(text):
+    units = {'K': 1 << 10, 'M': 1 << 20, 'G': 1 << 30}
+    text = text.strip().upper().rstrip('B').rstrip('I')
+    if text and text[-1] in units:
+        return int(float(text[:-1]) * units[text[-1]])
+    return int(text)
+
+
+def run_adapter(command, mode, source, target, min_time, raw_size):
+    args = command + [mode, source, target, repr(min_time), str(raw_size)]
+    result = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+    if result.returncode != 0:
+        raise AdapterError('%s exited with %d: %s' % (mode, result.returncode, result.stderr.strip()))
+    try:
+        iterations, best = result.stdout.split()[-2:]
+        return int(iterations), int(best)
+    except ValueError:
+        raise AdapterError('%s printed %r' % (mode, result.stdout))
+
+
+def read(path):
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+def describe_difference(actual, expected):
+    if len(actual) != len(expected) and actual == expected[:len(actual)]:
+        return '%d bytes instead of %d' % (len(actual), len(expected))
+    offset = next((i for i, (a, b) in enumerate(zip(actual, expected)) if a != b), min(len(actual), len(expected)))
+    return 'differs at byte %d (%d bytes instead of %d)' % (offset, len(actual), len(expected))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--impl', action='append',
+                        help='comma-separated implementations to run (default: all), from: %s'
+                        % ', '.join(name for name, _, _, _ in IMPLEMENTATIONS))
+    parser.add_argument('--corpus', help='directory of files to use instead of the generated corpus')
+    parser.add_argument('--size', default='256K', help='size of each generated corpus file (default 256K)')
+    parser.add_argument('--min-time', type=float, default=0.5,
+                        help='seconds to repeat each operation for the throughput figures (default 0.5)')
+    parser.add_argument('--verbose', '-v', action='store_true', help='report every file')
+    parser.add_argument('--strict', action='store_true', help='count the mismatches in KNOWN_FAILURES as failures')
+    args = parser.parse_args()
+
+    selected = None
+    if args.impl:
+        selected = {name.strip() for group in args.impl for name in group.split(',') if name.strip()}
+        unknown = selected - {name for name, _, _, _ in IMPLEMENTATIONS} - {name for name, _ in UNSUPPORTED}
+        if unknown:
+            parser.error('unknown implementation: %s' % ', '.join(sorted(unknown)))
+
+    os.makedirs(BUILD, exist_ok=True)
+    if args.corpus:
+        corpus = sorted(os.path.join(args.corpus, name) for name in os.listdir(args.corpus)
+                        if os.path.isfile(os.path.join(args.corpus, name)))
+    else:
+        corpus = make_corpus(os.path.join(BUILD, 'corpus-%d' % parse_size(args.size)), parse_size(args.size))
+    if not corpus:
+        parser.error('the corpus is empty')
+
+    # The reference of a format runs first even when it was not selected, as
+    # the others are compared against its output
+    references = {}
+    runs = []
+    for name, stream_format, build, description in IMPLEMENTATIONS:
+        is_reference = stream_format not in references
+        if is_reference:
+            references[stream_format] = name
+        if selected is not None and name not in selected and not (is_reference and any(
+                other in selected for other, f, _, _ in IMPLEMENTATIONS if f == stream_format)):
+            continue
+        runs.append((name, stream_format, build, description))
+    for name, reason in UNSUPPORTED:
+        if selected is None or name in selected:
+            print('%-11s skipped: %s' % (name, reason))
+
+    expected = {}
+    failures = 0
+    report = []
+    for name, stream_format, build, description in runs:
+        try:
+            command = build()
+        except AdapterError as error:
+            print('%-11s FAIL %s' % (name, error))
+            failures += 1
+            continue
+        if command is None:
+            print('%-11s skipped: toolchain not found' % name)
+            continue
+
+        output_dir = os.path.join(BUILD, 'out', name)
+        os.makedirs(output_dir, exist_ok=True)
+        is_reference = references[stream_format] == name
+        expected_checks = set() if args.strict else KNOWN_FAILURES.get(name, (set(), None))[0]
+        # (check, message); check is 'compress', 'decompress' or None for errors
+        problems = []
+        raw_total = 0
+        packed_total = 0
+        compress_ns = 0
+        decompress_ns = 0
+        for path in corpus:
+            file_name = os.path.basename(path)
+            original = read(path)
+            packed_path = os.path.join(output_dir, file_name + '.lzss')
+            unpacked_path = os.path.join(output_dir, file_name + '.out')
+            key = (stream_format, file_name)
+            timed = len(original) >= THROUGHPUT_MIN_SIZE
+            min_time = args.min_time if timed else 0
+            try:
+                _, compress_best = run_adapter(command, 'compress', path, packed_path, min_time, len(original))
+                packed = read(packed_path)
+                if is_reference:
+                    expected[key] = packed_path
+                elif key not in expected:
+                    raise AdapterError('no reference stream to compare with')
+                elif packed != read(expected[key]):
+                    problems.append(('compress', '%s: compressed output %s' % (file_name, describe_difference(
+                        packed, read(expected[key])))))
+
+                _, decompress_best = run_adapter(command, 'decompress', expected[key], unpacked_path, min_time,
+                                                 len(original))
+                unpacked = read(unpacked_path)
+                if unpacked != original:
+                    problems.append(('decompress', '%s: decompressed reference stream %s' % (
+                        file_name, describe_difference(unpacked, original))))
+            except AdapterError as error:
+                problems.append((None, '%s: %s' % (file_name, error)))
+                continue
+
+            if args.verbose:
+                print('%-11s %-14s %10d -> %10d  %9.1f MB/s  %9.1f MB/s' % (
+                    name, file_name, len(original), len(packed),
+                    len(original) * 1e3 / max(compress_best, 1), len(original) * 1e3 / max(decompress_best, 1)))
+            if timed:
+                raw_total += len(original)
+                packed_total += len(packed)
+                compress_ns += compress_best
+                decompress_ns += decompress_best
+
+        unexpected = [message for check, message in problems if check not in expected_checks]
+        known = [message for check, message in problems if check in expected_checks]
+        if unexpected:
+            status = 'FAIL'
+            failures += 1
+        elif known:
+            status = 'xfail'
+        else:
+            status = 'reference' if is_reference else 'identical'
+        report.append((name, description, status, raw_total, packed_total, compress_ns, decompress_ns))
+        for label, messages in (('FAIL', unexpected), ('XFAIL', known)):
+            for message in messages[:10]:
+                print('%-11s %s %s' % (name, label, message))
+            if len(messages) > 10:
+                print('%-11s %s ... %d more' % (name, label, len(messages) - 10))
+        if known:
+            print('%-11s       known bug: %s' % (name, KNOWN_FAILURES[name][1]))
+        for check in sorted(expected_checks - {check for check, _ in problems}):
+            print('%-11s XPASS %s passes on every file; drop it from KNOWN_FAILURES' % (name, check))
+
+    print()
+    print('%-11s %-10s %14s %16s %7s  %s' % ('impl', 'status', 'compress MB/s', 'decompress MB/s', 'ratio',
+                                            'implementation'))
+    for name, description, status, raw_total, packed_total, compress_ns, decompress_ns in report:
+        if raw_total:
+            figures = '%14.1f %16.1f %7.3f' % (raw_total * 1e3 / max(compress_ns, 1),
+                                               raw_total * 1e3 / max(decompress_ns, 1), packed_total / raw_total)
+        else:
+            figures = '%14s %16s %7s' % ('-', '-', '-')
+        print('%-11s %-10s %s  %s' % (name, status, figures, description))
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())